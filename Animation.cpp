@@ -0,0 +1,225 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Animation.h"
+#include "Scene.h"
+
+using namespace std;
+
+Keyframe::Keyframe()
+{
+    this->frame = 0;
+
+    for (int i = 0; i < 6; i++)
+    {
+        this->values[i] = 0.0;
+    }
+}
+
+Keyframe::Keyframe(int frame, double values[6])
+{
+    this->frame = frame;
+
+    for (int i = 0; i < 6; i++)
+    {
+        this->values[i] = values[i];
+    }
+}
+
+AnimationTrack::AnimationTrack()
+{
+    this->targetType = TargetNone;
+    this->targetId = -1;
+}
+
+AnimationTrack::AnimationTrack(AnimationTarget targetType, int targetId)
+{
+    this->targetType = targetType;
+    this->targetId = targetId;
+}
+
+int AnimationTrack::targetCount(const Scene &scene)
+{
+    switch (this->targetType)
+    {
+    case TargetTranslation:
+        return scene.translations.size();
+
+    case TargetScaling:
+        return scene.scalings.size();
+
+    case TargetRotation:
+        return scene.rotations.size();
+
+    case TargetNone:
+        return 0;
+
+    default:
+        return scene.cameras.size();
+    }
+}
+
+/*
+    Number of values a keyframe of this track carries.
+*/
+int AnimationTrack::numberOfValues()
+{
+    switch (this->targetType)
+    {
+    case TargetRotation:
+        return 4; // angle ux uy uz
+
+    case TargetCameraImagePlane:
+        return 6; // left right bottom top near far
+
+    default:
+        return 3;
+    }
+}
+
+/*
+    Linearly interpolates the keyframes around the given frame.
+    Frames before the first or after the last keyframe hold its values.
+    Keyframes are expected to be sorted by frame.
+*/
+void AnimationTrack::sample(int frame, double values[6])
+{
+    int n = this->numberOfValues();
+
+    if (frame <= this->keyframes.front().frame)
+    {
+        for (int i = 0; i < n; i++)
+            values[i] = this->keyframes.front().values[i];
+        return;
+    }
+
+    if (frame >= this->keyframes.back().frame)
+    {
+        for (int i = 0; i < n; i++)
+            values[i] = this->keyframes.back().values[i];
+        return;
+    }
+
+    int k = 0;
+    while (this->keyframes[k + 1].frame <= frame)
+    {
+        k++;
+    }
+
+    Keyframe &k0 = this->keyframes[k];
+    Keyframe &k1 = this->keyframes[k + 1];
+    double alpha = (double)(frame - k0.frame) / (k1.frame - k0.frame);
+
+    for (int i = 0; i < n; i++)
+    {
+        values[i] = k0.values[i] + (k1.values[i] - k0.values[i]) * alpha;
+    }
+}
+
+Animation::Animation()
+{
+    this->frameCount = 0;
+}
+
+Animation::Animation(int frameCount)
+{
+    this->frameCount = frameCount;
+}
+
+/*
+    Writes the values of every track at the given frame into the
+    transformations and cameras of the scene. Geometry is untouched.
+    Tracks are checked against the scene when it is loaded.
+*/
+void Animation::applyFrame(Scene &scene, int frame)
+{
+    double values[6];
+
+    for (int i = 0; i < this->tracks.size(); i++)
+    {
+        AnimationTrack &track = this->tracks[i];
+        int id = track.targetId - 1;
+
+        track.sample(frame, values);
+
+        switch (track.targetType)
+        {
+        case TargetTranslation:
+        {
+            Translation *t = scene.translations[id];
+            t->tx = values[0];
+            t->ty = values[1];
+            t->tz = values[2];
+            break;
+        }
+
+        case TargetScaling:
+        {
+            Scaling *s = scene.scalings[id];
+            s->sx = values[0];
+            s->sy = values[1];
+            s->sz = values[2];
+            break;
+        }
+
+        case TargetRotation:
+        {
+            Rotation *r = scene.rotations[id];
+            r->angle = values[0];
+            r->ux = values[1];
+            r->uy = values[2];
+            r->uz = values[3];
+            break;
+        }
+
+        case TargetCameraPosition:
+            scene.cameras[id]->pos = Vec3(values[0], values[1], values[2], -1);
+            break;
+
+        case TargetCameraGaze:
+            scene.cameras[id]->gaze = Vec3(values[0], values[1], values[2], -1);
+            scene.cameras[id]->computeBasis();
+            break;
+
+        case TargetCameraUp:
+            scene.cameras[id]->up = Vec3(values[0], values[1], values[2], -1);
+            scene.cameras[id]->computeBasis();
+            break;
+
+        case TargetCameraImagePlane:
+        {
+            Camera *cam = scene.cameras[id];
+            cam->left = values[0];
+            cam->right = values[1];
+            cam->bottom = values[2];
+            cam->top = values[3];
+            cam->near = values[4];
+            cam->far = values[5];
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+    Inserts the zero padded frame number before the extension:
+    "turntable.ppm" -> "turntable_0007.ppm"
+*/
+string Animation::frameFileName(string fileName, int frame)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "_%04d", frame);
+
+    size_t dot = fileName.find_last_of('.');
+    size_t slash = fileName.find_last_of("/\\");
+
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        return fileName + number;
+    }
+
+    return fileName.substr(0, dot) + number + fileName.substr(dot);
+}
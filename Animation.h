@@ -0,0 +1,64 @@
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Scene;
+
+// what a track animates, cameras have one track per field
+enum AnimationTarget
+{
+    TargetNone,
+    TargetTranslation,
+    TargetScaling,
+    TargetRotation,
+    TargetCameraPosition,
+    TargetCameraGaze,
+    TargetCameraUp,
+    TargetCameraImagePlane
+};
+
+class Keyframe
+{
+public:
+    int frame;
+    double values[6];
+
+    Keyframe();
+    Keyframe(int frame, double values[6]);
+};
+
+class AnimationTrack
+{
+public:
+    AnimationTarget targetType;
+    int targetId; // 1-based index into the scene's translations, scalings, rotations or cameras
+    vector<Keyframe> keyframes;
+
+    AnimationTrack();
+    AnimationTrack(AnimationTarget targetType, int targetId);
+
+    // number of targets of this track's type in scene, ids above it do not exist
+    int targetCount(const Scene &scene);
+
+    int numberOfValues();
+    void sample(int frame, double values[6]);
+};
+
+class Animation
+{
+public:
+    int frameCount;
+    vector<AnimationTrack> tracks;
+
+    Animation();
+    Animation(int frameCount);
+
+    void applyFrame(Scene &scene, int frame);
+    string frameFileName(string fileName, int frame);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Helpers.h"
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -24,6 +25,7 @@ Camera::Camera(int cameraId,
     this->u = u;
     this->v = v;
     this->w = w;
+    this->up = v;
     this->left = left;
     this->right = right;
     this->bottom = bottom;
@@ -44,6 +46,7 @@ Camera::Camera(const Camera &other)
     this->u = other.u;
     this->v = other.v;
     this->w = other.w;
+    this->up = other.up;
     this->left = other.left;
     this->right = other.right;
     this->bottom = other.bottom;
@@ -55,6 +58,21 @@ Camera::Camera(const Camera &other)
     this->outputFileName = other.outputFileName;
 }
 
+/*
+    Derives the orthonormal camera basis (u, v, w) from gaze and up.
+    Normalizes gaze as a side effect.
+*/
+void Camera::computeBasis()
+{
+    this->gaze = normalizeVec3(this->gaze);
+    this->u = crossProductVec3(this->gaze, this->up);
+    this->u = normalizeVec3(this->u);
+
+    this->w = inverseVec3(this->gaze);
+    this->v = crossProductVec3(this->u, this->gaze);
+    this->v = normalizeVec3(this->v);
+}
+
 ostream &operator<<(ostream &os, const Camera &c)
 {
     const char *camType = c.projectionType ? "perspective" : "orthographic";
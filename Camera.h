@@ -17,6 +17,7 @@ public:
     Vec3 u;
     Vec3 v;
     Vec3 w;
+    Vec3 up; // up vector as given in the input, u v w are derived from it
     double left, right, bottom, top;
     double near;
     double far;
@@ -37,6 +38,8 @@ public:
 
     Camera(const Camera &other);
 
+    void computeBasis();
+
     friend std::ostream &operator<<(std::ostream &os, const Camera &c);
 };
 
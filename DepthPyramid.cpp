@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "DepthPyramid.h"
+
+using namespace std;
+
+DepthPyramid::DepthPyramid()
+{
+    this->width = 0;
+    this->height = 0;
+}
+
+void DepthPyramid::reset(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    this->widths.clear();
+    this->heights.clear();
+
+    int w = max(1, (width + cellSize - 1) / cellSize);
+    int h = max(1, (height + cellSize - 1) / cellSize);
+    int level = 0;
+
+    while (true)
+    {
+        this->widths.push_back(w);
+        this->heights.push_back(h);
+
+        if (this->levels.size() <= level)
+        {
+            this->levels.push_back(vector<double>());
+        }
+        this->levels[level].assign((size_t)w * h, numeric_limits<double>::infinity());
+        level++;
+
+        if (w == 1 && h == 1)
+        {
+            break;
+        }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    this->levels.resize(level);
+}
+
+void DepthPyramid::update(const vector< vector<double> > &depth, int xMin, int yMin, int xMax, int yMax)
+{
+    xMin = max(xMin, 0);
+    yMin = max(yMin, 0);
+    xMax = min(xMax, this->width);
+    yMax = min(yMax, this->height);
+
+    if (xMin >= xMax || yMin >= yMax)
+    {
+        return;
+    }
+
+    // cells touched by the region, in cells of the current level
+    int cxMin = xMin / cellSize, cyMin = yMin / cellSize;
+    int cxMax = (xMax - 1) / cellSize, cyMax = (yMax - 1) / cellSize;
+
+    vector<double> &cells = this->levels[0];
+    for (int cy = cyMin; cy <= cyMax; cy++)
+    {
+        for (int cx = cxMin; cx <= cxMax; cx++)
+        {
+            double farthest = 0;
+            int xEnd = min((cx + 1) * cellSize, this->width), yEnd = min((cy + 1) * cellSize, this->height);
+
+            for (int x = cx * cellSize; x < xEnd; x++)
+            {
+                for (int y = cy * cellSize; y < yEnd; y++)
+                {
+                    farthest = max(farthest, depth[x][y]);
+                }
+            }
+            cells[(size_t)cy * this->widths[0] + cx] = farthest;
+        }
+    }
+
+    for (int level = 1; level < this->levels.size(); level++)
+    {
+        cxMin /= 2; cyMin /= 2; cxMax /= 2; cyMax /= 2;
+
+        const vector<double> &below = this->levels[level - 1];
+        int belowWidth = this->widths[level - 1], belowHeight = this->heights[level - 1];
+
+        for (int cy = cyMin; cy <= cyMax; cy++)
+        {
+            for (int cx = cxMin; cx <= cxMax; cx++)
+            {
+                double farthest = 0;
+                for (int y = 2 * cy; y < min(2 * cy + 2, belowHeight); y++)
+                {
+                    for (int x = 2 * cx; x < min(2 * cx + 2, belowWidth); x++)
+                    {
+                        farthest = max(farthest, below[(size_t)y * belowWidth + x]);
+                    }
+                }
+                this->levels[level][(size_t)cy * this->widths[level] + cx] = farthest;
+            }
+        }
+    }
+}
+
+bool DepthPyramid::occluded(int xMin, int yMin, int xMax, int yMax, double zMin) const
+{
+    xMin = max(xMin, 0);
+    yMin = max(yMin, 0);
+    xMax = min(xMax, this->width);
+    yMax = min(yMax, this->height);
+
+    if (xMin >= xMax || yMin >= yMax)
+    {
+        return false;
+    }
+
+    int cxMin = xMin / cellSize, cyMin = yMin / cellSize;
+    int cxMax = (xMax - 1) / cellSize, cyMax = (yMax - 1) / cellSize;
+    int level = 0;
+
+    // a few cells of a coarser level answer faster than many fine ones
+    while ((cxMax - cxMin + 1) * (cyMax - cyMin + 1) > 64 && level + 1 < this->levels.size())
+    {
+        cxMin /= 2; cyMin /= 2; cxMax /= 2; cyMax /= 2;
+        level++;
+    }
+
+    const vector<double> &cells = this->levels[level];
+    for (int cy = cyMin; cy <= cyMax; cy++)
+    {
+        for (int cx = cxMin; cx <= cxMax; cx++)
+        {
+            if (cells[(size_t)cy * this->widths[level] + cx] >= zMin)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
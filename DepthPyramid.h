@@ -0,0 +1,37 @@
+#ifndef __DEPTH_PYRAMID_H__
+#define __DEPTH_PYRAMID_H__
+
+#include <vector>
+
+using namespace std;
+
+/*
+    Coarse levels of a depth buffer for occlusion tests. Level 0 holds the
+    farthest depth of every cellSize x cellSize block of pixels, each level
+    above it the farthest of 2 x 2 cells of the one below. Anything whose
+    nearest depth lies beyond the farthest depth of all cells it touches is
+    hidden. Depth buffers are indexed [x][y], as the image is.
+*/
+class DepthPyramid
+{
+public:
+    static const int cellSize = 8;
+
+    DepthPyramid();
+
+    // sizes the pyramid for a width x height buffer with nothing drawn
+    void reset(int width, int height);
+
+    // takes the depths of [xMin, xMax) x [yMin, yMax) of depth into account
+    void update(const vector< vector<double> > &depth, int xMin, int yMin, int xMax, int yMax);
+
+    // true when all of [xMin, xMax) x [yMin, yMax) is drawn nearer than zMin
+    bool occluded(int xMin, int yMin, int xMax, int yMax, double zMin) const;
+
+private:
+    int width, height;
+    vector<int> widths, heights; // cells of each level
+    vector< vector<double> > levels; // cells row by row
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include <cstring>
+#include <vector>
+#include "FaceParser.h"
+#include "Triangle.h"
+
+using namespace std;
+
+static inline bool isRowSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+ * Reads an optionally signed decimal integer at p. On success stores it in
+ * value and returns the position after it, otherwise returns NULL.
+ */
+static inline const char *scanInt(const char *p, int &value)
+{
+    bool negative = false;
+
+    if (*p == '-' || *p == '+')
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (*p < '0' || *p > '9')
+    {
+        return NULL;
+    }
+
+    int result = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+
+    value = negative ? -result : result;
+    return p;
+}
+
+/*
+ * Behaves like the former strtok + sscanf("%d %d %d") loop: a row that is not
+ * blank always yields a triangle, and indices missing from a malformed row keep
+ * the values of the previous row.
+ */
+int parseFaces(const char *text, vector<Triangle> &triangles)
+{
+    if (text == NULL)
+    {
+        return 0;
+    }
+
+    // one row per line at most, so the index array is allocated once
+    size_t rows = 1;
+    for (const char *p = strchr(text, '\n'); p != NULL; p = strchr(p + 1, '\n'))
+    {
+        rows++;
+    }
+    triangles.reserve(triangles.size() + rows);
+
+    size_t before = triangles.size();
+    int v[3] = {0, 0, 0};
+    const char *p = text;
+
+    while (*p != '\0')
+    {
+        while (isRowSpace(*p))
+        {
+            p++;
+        }
+
+        if (*p == '\n')
+        {
+            p++;
+            continue;
+        }
+
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            while (isRowSpace(*p))
+            {
+                p++;
+            }
+
+            const char *next = scanInt(p, v[i]);
+            if (next == NULL)
+            {
+                break;
+            }
+            p = next;
+        }
+
+        triangles.push_back(Triangle(v[0], v[1], v[2]));
+
+        // skip whatever is left of the row
+        while (*p != '\n' && *p != '\0')
+        {
+            p++;
+        }
+    }
+
+    return triangles.size() - before;
+}
@@ -0,0 +1,16 @@
+#ifndef __FACE_PARSER_H__
+#define __FACE_PARSER_H__
+
+#include <vector>
+#include "Triangle.h"
+
+using namespace std;
+
+/*
+ * Parses the text of a <Faces> element, one "v1 v2 v3" row per line, and
+ * appends the triangles. Reads the text in place, no copy is made.
+ * Blank lines are skipped. Returns the number of triangles appended.
+ */
+int parseFaces(const char *text, vector<Triangle> &triangles);
+
+#endif
@@ -0,0 +1,93 @@
+#include "ImageWriter.h"
+#include "Scene.h"
+
+using namespace std;
+
+/*
+    osType selects the PNG conversion, see Scene::convertPPMToPNG.
+*/
+ImageWriter::ImageWriter(int maxInFlight, int osType)
+{
+    this->maxInFlight = maxInFlight > 0 ? maxInFlight : 1;
+    this->osType = osType;
+    this->finished = false;
+    this->worker = thread(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+    finish();
+}
+
+/*
+    Takes ownership of the contents of image and gives back an already written
+    buffer in its place (or an empty one), to be reinitialized by the caller.
+    Blocks while maxInFlight images are already waiting to be written.
+*/
+void ImageWriter::submit(vector< vector<Color> > &image, Camera &camera)
+{
+    ImageWriteJob *job = new ImageWriteJob();
+    job->image.swap(image);
+    job->camera = camera;
+
+    unique_lock<mutex> lock(this->queueMutex);
+    this->queueChanged.wait(lock, [this] { return this->queue.size() < this->maxInFlight; });
+    this->queue.push_back(job);
+    this->queueChanged.notify_all();
+
+    if (!this->freeImages.empty())
+    {
+        image.swap(this->freeImages.back());
+        this->freeImages.pop_back();
+    }
+}
+
+/*
+    Waits until every submitted image is written and stops the thread.
+*/
+void ImageWriter::finish()
+{
+    {
+        lock_guard<mutex> lock(this->queueMutex);
+        this->finished = true;
+        this->queueChanged.notify_all();
+    }
+
+    if (this->worker.joinable())
+    {
+        this->worker.join();
+    }
+}
+
+void ImageWriter::run()
+{
+    while (true)
+    {
+        ImageWriteJob *job;
+        {
+            unique_lock<mutex> lock(this->queueMutex);
+            this->queueChanged.wait(lock, [this] { return !this->queue.empty() || this->finished; });
+
+            if (this->queue.empty())
+            {
+                return;
+            }
+
+            job = this->queue.front();
+        }
+
+        Scene::writeImageToPPMFile(job->image, &job->camera);
+        Scene::convertPPMToPNG(job->camera.outputFileName, this->osType);
+
+        {
+            // the job stays queued while it is written so that it counts as in flight
+            lock_guard<mutex> lock(this->queueMutex);
+            this->queue.pop_front();
+            this->freeImages.push_back(vector< vector<Color> >());
+            this->freeImages.back().swap(job->image);
+            this->queueChanged.notify_all();
+        }
+
+        delete job;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __IMAGE_WRITER_H__
+#define __IMAGE_WRITER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Camera.h"
+#include "Color.h"
+
+using namespace std;
+
+class ImageWriteJob
+{
+public:
+    vector< vector<Color> > image;
+    Camera camera;
+};
+
+/*
+    Writes rendered images (PPM, then PNG conversion) on a background thread
+    so that rendering of the next image can proceed while the previous one is
+    encoded. At most maxInFlight images wait in the queue, submit blocks beyond
+    that. Written buffers are handed back to the renderer by later submits, so
+    no more than maxInFlight + 1 framebuffers are ever allocated.
+*/
+class ImageWriter
+{
+public:
+    ImageWriter(int maxInFlight, int osType);
+    ~ImageWriter();
+
+    void submit(vector< vector<Color> > &image, Camera &camera);
+    void finish();
+
+private:
+    int maxInFlight;
+    int osType;
+    bool finished;
+    deque<ImageWriteJob *> queue;
+    vector< vector< vector<Color> > > freeImages;
+    mutex queueMutex;
+    condition_variable queueChanged;
+    thread worker;
+
+    void run();
+};
+
+#endif
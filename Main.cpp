@@ -1,45 +1,421 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdlib>
+#include <climits>
+#include <fstream>
+#include <sstream>
 #include "Scene.h"
 #include "Matrix4.h"
 #include "Helpers.h"
+#include "ImageWriter.h"
+#include "TileRendering.h"
 
 using namespace std;
 
 Scene *scene;
 
+// "name.ppm" becomes "name_preview8.ppm" for the 1/8 resolution preview
+static string previewFileName(string fileName, int factor)
+{
+    size_t dot = fileName.rfind('.');
+    size_t slash = fileName.rfind('/');
+
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        dot = fileName.size();
+    }
+
+    return fileName.substr(0, dot) + "_preview" + to_string(factor) + fileName.substr(dot);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    const char *xmlPath = NULL;
+    int maxInFlight = 2;
+    bool overdraw = false;
+    int streamChunkSize = 65536;
+    int spawnWorkers = 0;
+    int tileSize = 128;
+    vector<string> workerAddresses;
+    int workerPort = 0;
+    string bindAddress;
+    string rootDirectory;
+    bool scissor = false;
+    bool progressive = false;
+    bool printStats = false;
+    double lodThreshold = -1;
+    bool depthTest = false;
+    bool occlusionCulling = false;
+    bool frontToBack = false;
+    bool depthPrepass = false;
+    string interpolation;
+    int multisampleCount = 0;
+    string framebufferLayout;
+    int threadCount = 0;
+    int scissorRect[4];
+    bool validArguments = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--max-in-flight" && i + 1 < argc)
+        {
+            maxInFlight = atoi(argv[++i]);
+        }
+        else if (arg == "--stream-chunk" && i + 1 < argc)
+        {
+            streamChunkSize = atoi(argv[++i]);
+        }
+        else if (arg == "--overdraw")
+        {
+            overdraw = true;
+        }
+        else if (arg == "--worker" && i + 1 < argc)
+        {
+            workerPort = atoi(argv[++i]);
+            validArguments = validArguments && workerPort > 0;
+        }
+        else if (arg == "--bind" && i + 1 < argc)
+        {
+            bindAddress = argv[++i];
+        }
+        else if (arg == "--root" && i + 1 < argc)
+        {
+            rootDirectory = argv[++i];
+        }
+        else if (arg == "--spawn" && i + 1 < argc)
+        {
+            spawnWorkers = atoi(argv[++i]);
+        }
+        else if (arg == "--connect" && i + 1 < argc)
+        {
+            workerAddresses.push_back(argv[++i]);
+        }
+        else if (arg == "--scissor" && i + 4 < argc)
+        {
+            scissor = true;
+            for (int k = 0; k < 4; k++)
+            {
+                scissorRect[k] = atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--progressive")
+        {
+            progressive = true;
+        }
+        else if (arg == "--lod" && i + 1 < argc)
+        {
+            lodThreshold = atof(argv[++i]);
+        }
+        else if (arg == "--depth")
+        {
+            depthTest = true;
+        }
+        else if (arg == "--occlusion")
+        {
+            occlusionCulling = true;
+        }
+        else if (arg == "--front-to-back")
+        {
+            frontToBack = true;
+        }
+        else if (arg == "--depth-prepass")
+        {
+            depthPrepass = true;
+        }
+        else if (arg == "--interpolation" && i + 1 < argc)
+        {
+            interpolation = argv[++i];
+            validArguments = validArguments && (interpolation == "perspective" || interpolation == "linear");
+        }
+        else if (arg == "--msaa" && i + 1 < argc)
+        {
+            multisampleCount = atoi(argv[++i]);
+            validArguments = validArguments && Scene::validSampleCount(multisampleCount);
+        }
+        else if (arg == "--framebuffer" && i + 1 < argc)
+        {
+            framebufferLayout = argv[++i];
+            validArguments = validArguments && (framebufferLayout == "linear" || framebufferLayout == "tiled");
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+            validArguments = validArguments && threadCount > 0;
+        }
+        else if (arg == "--stats")
+        {
+            printStats = true;
+        }
+        else if (arg == "--tile" && i + 1 < argc)
+        {
+            tileSize = atoi(argv[++i]);
+        }
+        else if (xmlPath == NULL && arg[0] != '-')
+        {
+            xmlPath = argv[i];
+        }
+        else
+        {
+            validArguments = false;
+        }
+    }
+
+    // a worker takes everything else from its coordinators, it only listens on loopback unless told otherwise
+    if (workerPort > 0 && validArguments && xmlPath == NULL)
+    {
+        return runTileWorker(bindAddress.empty() ? "127.0.0.1" : bindAddress, workerPort, rootDirectory);
+    }
+
+    if (workerPort > 0 || !bindAddress.empty() || !rootDirectory.empty())
+    {
+        validArguments = false;
+    }
+
+    // previews are rendered locally and at whole-image scale
+    if (progressive && (scissor || spawnWorkers > 0 || !workerAddresses.empty()))
+    {
+        validArguments = false;
+    }
+
+    // workers take level of detail, interpolation, multisampling, the framebuffer layout and the depth test options from the scene file only
+    if ((lodThreshold >= 0 || depthTest || occlusionCulling || frontToBack || depthPrepass || multisampleCount > 0 ||
+         !interpolation.empty() || !framebufferLayout.empty()) && (spawnWorkers > 0 || !workerAddresses.empty()))
+    {
+        validArguments = false;
+    }
+
+    // overdraw counts and stats are gathered while rasterizing, workers do not send them back
+    if ((overdraw || printStats) && (spawnWorkers > 0 || !workerAddresses.empty()))
+    {
+        validArguments = false;
+    }
+
+    // workers are sent the scene file, a mesh file given alone has none
+    if (xmlPath != NULL && isMeshFileName(xmlPath) && (spawnWorkers > 0 || !workerAddresses.empty()))
+    {
+        validArguments = false;
+    }
+
+    if (xmlPath == NULL || !validArguments)
     {
         cout << "Please run the rasterizer as:" << endl
-             << "\t./rasterizer <input_file_name>" << endl;
+             << "\t./rasterizer [options] <input_file_name>" << endl
+             << "\t./rasterizer [options] <mesh.obj|mesh.ply>\tdraw a mesh file alone, seen from +z, into mesh.ppm (not with workers)" << endl
+             << "\t./rasterizer --worker <port> [--bind <address>] [--root <directory>]" << endl
+             << "Options:" << endl
+             << "\t--max-in-flight <n>\timages waiting to be written while rendering continues (default 2)" << endl
+             << "\t--stream-chunk <n>\ttriangles read at once from meshes given as stream=\"file.stl\" (default 65536)" << endl
+             << "\t--overdraw\t\twrite how often each pixel was drawn as a false-color image and print histograms (not with workers)" << endl
+             << "\t--scissor <xmin> <ymin> <xmax> <ymax>\trender only [xmin, xmax) x [ymin, ymax) of every camera and write the crop" << endl
+             << "\t--progressive\t\twrite 1/8, 1/4 and 1/2 resolution previews before each image (not with --scissor or workers)" << endl
+             << "\t--lod <pixels>\t\tdraw meshes with the coarsest level of detail whose error is at most this many pixels" << endl
+             << "\t--depth\t\t\tdraw with a depth buffer, nearer pixels win over later ones" << endl
+             << "\t--occlusion\t\tskip meshes hidden behind what is already drawn (implies --depth)" << endl
+             << "\t--front-to-back\t\tdraw solid meshes nearest first (implies --depth)" << endl
+             << "\t--depth-prepass\t\trasterize depth first, then shade only visible pixels of solid meshes (implies --depth)" << endl
+             << "\t--interpolation <mode>\tinterpolate colors correctly for perspective (default) or linearly on screen" << endl
+             << "\t--msaa <n>\t\tanti-alias edges with n samples per pixel, 1, 2, 4 or 8 (1 turns it off)" << endl
+             << "\t--framebuffer <layout>\tstore pixels while rendering as linear columns (default) or tiled in 8 x 8 tiles (not with --msaa)" << endl
+             << "\t--threads <n>\t\tproject meshes and rasterize screen tiles on n threads (default all hardware threads)" << endl
+             << "\t--stats\t\t\tprint triangle counts and thread times of every image (not with workers)" << endl
+             << "\t--spawn <n>\t\trender in tiles on n worker processes started on this machine" << endl
+             << "\t--connect <host:port>\trender in tiles on a worker started with --worker, may be repeated" << endl
+             << "\t--tile <n>\t\ttile width and height for --spawn and --connect (default 128)" << endl
+             << "\t--worker <port>\t\tserve tile requests of coordinators on a TCP port" << endl
+             << "\t--bind <address>\taddress the worker listens on (default 127.0.0.1, 0.0.0.0 for every interface)" << endl
+             << "\t--root <directory>\tdirectory the worker reads mesh files from, names outside it are refused (default the working directory)" << endl;
         return 1;
     }
     else
     {
-        const char *xmlPath = argv[1];
+        // workers are forked before the scene parser and the writer start their threads
+        TileCoordinator *coordinator = NULL;
+
+        if (spawnWorkers > 0 || !workerAddresses.empty())
+        {
+            coordinator = new TileCoordinator(tileSize);
+
+            if (!coordinator->spawnLocalWorkers(spawnWorkers))
+            {
+                return 1;
+            }
+
+            for (int i = 0; i < workerAddresses.size(); i++)
+            {
+                size_t colon = workerAddresses[i].rfind(':');
+                if (colon == string::npos || !coordinator->connectWorker(workerAddresses[i].substr(0, colon), atoi(workerAddresses[i].c_str() + colon + 1)))
+                {
+                    cerr << "cannot use worker " << workerAddresses[i] << endl;
+                    return 1;
+                }
+            }
+
+            // workers resolve mesh files against the absolute directory of the scene
+            ifstream fin(xmlPath);
+            stringstream xmlText;
+            xmlText << fin.rdbuf();
+
+            char resolved[PATH_MAX];
+            string directory = realpath(xmlPath, resolved) != NULL ? resolved : xmlPath;
+            directory = directory.substr(0, directory.find_last_of('/') + 1);
+
+            if (!fin || !coordinator->sendScene(xmlText.str(), directory))
+            {
+                cerr << "cannot send the scene to the workers" << endl;
+                return 1;
+            }
+        }
+
+        if (isMeshFileName(xmlPath))
+        {
+            scene = new Scene(string(xmlPath), 800);
+        }
+        else
+        {
+            scene = new Scene(xmlPath);
+        }
+        if (!scene->loaded)
+        {
+            cerr << "cannot load " << xmlPath << endl;
+            return 1;
+        }
+        scene->overdrawEnabled = overdraw;
+        scene->streamChunkSize = streamChunkSize > 0 ? streamChunkSize : 1;
 
-        scene = new Scene(xmlPath);
+        scene->depthTestEnabled = scene->depthTestEnabled || depthTest || occlusionCulling || frontToBack || depthPrepass;
+        scene->occlusionCullingEnabled = scene->occlusionCullingEnabled || occlusionCulling;
+        scene->frontToBackEnabled = scene->frontToBackEnabled || frontToBack;
+        scene->depthPrepassEnabled = scene->depthPrepassEnabled || depthPrepass;
+        if (!interpolation.empty())
+        {
+            scene->perspectiveCorrectEnabled = interpolation == "perspective";
+        }
+        if (multisampleCount > 0)
+        {
+            scene->multisampleCount = multisampleCount;
+        }
+        if (!framebufferLayout.empty())
+        {
+            scene->tiledFramebufferEnabled = framebufferLayout == "tiled";
+        }
+        if (scene->tiledFramebufferEnabled && scene->multisampleCount > 1)
+        {
+            cerr << "the tiled framebuffer cannot be used with multisampling" << endl;
+            return 1;
+        }
+        scene->threadCount = threadCount;
 
-        for (int i = 0; i < scene->cameras.size(); i++)
+        // levels given by <LevelOfDetail> are kept, only their threshold changes
+        if (lodThreshold >= 0)
         {
-            // initialize image with basic values
-            scene->initializeImage(scene->cameras[i]);
+            if (!scene->lodEnabled)
+            {
+                scene->buildLevelsOfDetail(4, 0.5);
+            }
+            scene->lodThreshold = lodThreshold;
+        }
+
+        if (scissor)
+        {
+            scene->setScissor(scissorRect[0], scissorRect[1], scissorRect[2], scissorRect[3]);
+        }
 
-            // do forward rendering pipeline operations
-            scene->forwardRenderingPipeline(scene->cameras[i]);
+        // Images are written on a background thread while the next camera (or frame) is rendered.
+        // The writer also converts each PPM image to PNG, by calling ImageMagick's 'convert' command.
+        // Notice that os_type is not given as 1 (Ubuntu) or 2 (Windows), so it doesn't do conversion.
+        // Change os_type to 1 or 2, after being sure that you have ImageMagick installed.
+        ImageWriter writer(maxInFlight, 99);
 
-            // generate PPM file
-            scene->writeImageToPPMFile(scene->cameras[i]);
+        // without an animation the scene is rendered once as frame 0
+        int frameCount = scene->animation != NULL ? scene->animation->frameCount : 1;
 
-            // Converts PPM image in given path to PNG file, by calling ImageMagick's 'convert' command.
-            // Notice that os_type is not given as 1 (Ubuntu) or 2 (Windows), below call doesn't do conversion.
-            // Change os_type to 1 or 2, after being sure that you have ImageMagick installed.
-            scene->convertPPMToPNG(scene->cameras[i]->outputFileName, 99);
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            if (scene->animation != NULL)
+            {
+                scene->animation->applyFrame(*scene, frame);
+            }
+
+            for (int i = 0; i < scene->cameras.size(); i++)
+            {
+                Camera *camera = scene->cameras[i];
+
+                // progressive previews at 1/8, 1/4 and 1/2 resolution come first,
+                // every pass rasterizes the geometry projected once for the camera
+                int firstFactor = progressive ? 8 : 1;
+
+                if (progressive)
+                {
+                    scene->projectGeometry(camera);
+                }
+
+                for (int factor = firstFactor; factor >= 1; factor /= 2)
+                {
+                    Camera passCamera(*camera);
+                    passCamera.horRes = (camera->horRes + factor - 1) / factor;
+                    passCamera.verRes = (camera->verRes + factor - 1) / factor;
+
+                    // initialize image with basic values
+                    scene->initializeImage(&passCamera);
+
+                    // do forward rendering pipeline operations, or have the workers do them tile by tile
+                    if (coordinator != NULL)
+                    {
+                        if (!coordinator->render(frame, i, scene->drawXMin, scene->drawYMin, scene->drawXMax, scene->drawYMax, scene->image))
+                        {
+                            cerr << "no worker left to render " << camera->outputFileName << endl;
+                            return 1;
+                        }
+                    }
+                    else if (progressive)
+                    {
+                        scene->rasterizeGeometry(&passCamera);
+                    }
+                    else
+                    {
+                        scene->forwardRenderingPipeline(camera);
+                    }
+
+                    if (overdraw)
+                    {
+                        scene->showOverdraw(&passCamera);
+                    }
+
+                    // previews rasterize the same projection, its counts are printed once
+                    if (printStats && factor == 1)
+                    {
+                        cout << "Stats of camera " << camera->cameraId << " (" << camera->outputFileName << "):" << endl;
+                        scene->stats.print(cout);
+                    }
+
+                    // the image holds only the scissor, which is written as a crop
+                    Camera outputCamera(passCamera);
+                    outputCamera.horRes = scene->drawXMax - scene->drawXMin;
+                    outputCamera.verRes = scene->drawYMax - scene->drawYMin;
+
+                    if (scene->animation != NULL)
+                    {
+                        outputCamera.outputFileName = scene->animation->frameFileName(outputCamera.outputFileName, frame);
+                    }
+
+                    if (factor > 1)
+                    {
+                        outputCamera.outputFileName = previewFileName(outputCamera.outputFileName, factor);
+                    }
+
+                    // hand the image over to the writer, scene->image gets a recycled buffer back
+                    writer.submit(scene->image, outputCamera);
+                }
+            }
         }
 
+        writer.finish();
+        delete coordinator;
+        delete scene;
+
         return 0;
     }
-}
\ No newline at end of file
+}
@@ -3,10 +3,16 @@
 #include "Mesh.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 
 using namespace std;
 
-Mesh::Mesh() {}
+Mesh::Mesh()
+{
+    this->instanceOf = 0;
+    this->geometry = this;
+    this->hasBounds = false;
+}
 
 Mesh::Mesh(int meshId, int type, int numberOfTransformations,
              vector<int> transformationIds,
@@ -22,6 +28,35 @@ Mesh::Mesh(int meshId, int type, int numberOfTransformations,
     this->transformationIds = transformationIds;
     this->transformationTypes = transformationTypes;
     this->triangles = triangles;
+    this->instanceOf = 0;
+    this->geometry = this;
+    this->hasBounds = false;
+}
+
+void Mesh::computeBounds(const vector<Vec3 *> &vertices)
+{
+    this->hasBounds = !this->triangles.empty();
+
+    for (int i = 0; i < this->triangles.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            Vec3 *v = vertices[this->triangles[i].vertexIds[k] - 1];
+
+            if (i == 0 && k == 0)
+            {
+                this->boundsMin = *v;
+                this->boundsMax = *v;
+            }
+
+            this->boundsMin.x = min(this->boundsMin.x, v->x);
+            this->boundsMin.y = min(this->boundsMin.y, v->y);
+            this->boundsMin.z = min(this->boundsMin.z, v->z);
+            this->boundsMax.x = max(this->boundsMax.x, v->x);
+            this->boundsMax.y = max(this->boundsMax.y, v->y);
+            this->boundsMax.z = max(this->boundsMax.z, v->z);
+        }
+    }
 }
 
 ostream &operator<<(ostream &os, const Mesh &m)
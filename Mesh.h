@@ -1,8 +1,11 @@
 #ifndef __MESH_H__
 #define __MESH_H__
 
+#include <string>
 #include <vector>
+#include "Color.h"
 #include "Triangle.h"
+#include "Vec3.h"
 #include <iostream>
 
 using namespace std;
@@ -19,6 +22,22 @@ public:
     int numberOfTriangles;
     vector<Triangle> triangles;
 
+    // instances draw the triangles (or stream file) of another mesh with their own transformations
+    int instanceOf; // id given by the instanceOf attribute, 0 when the mesh has its own geometry
+    Mesh *geometry; // mesh whose triangles are drawn, this mesh unless it is an instance
+
+    // binary STL file streamed while rendering instead of triangles, empty otherwise
+    string streamFile;
+    Color streamColor; // facets of streamFile without a color of their own
+
+    // model space box around the triangles, false for streamed geometry
+    bool hasBounds;
+    Vec3 boundsMin, boundsMax;
+
+    // coarser versions of triangles, each about half the size of the one before
+    vector< vector<Triangle> > lodLevels;
+    vector<double> lodErrors; // geometric error of each level in model units
+
     Mesh();
     Mesh(int meshId, int type, int numberOfTransformations,
           vector<int> transformationIds,
@@ -26,6 +45,9 @@ public:
           int numberOfTriangles,
           vector<Triangle> triangles);
 
+    // computes the bounds of triangles, whose vertex ids index vertices
+    void computeBounds(const vector<Vec3 *> &vertices);
+
     friend ostream &operator<<(ostream &os, const Mesh &m);
 };
 
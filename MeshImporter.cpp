@@ -0,0 +1,762 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "MeshImporter.h"
+
+using namespace std;
+
+#define OBJ_CHUNK_SIZE (1 << 20)
+
+ImportedMesh::ImportedMesh()
+{
+    this->hasColors = false;
+}
+
+static bool endsWith(const string &text, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    if (text.size() < n)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (tolower(text[text.size() - n + i]) != suffix[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool importMeshFile(const string &path, const Color &defaultColor, ImportedMesh &mesh)
+{
+    if (endsWith(path, ".obj"))
+    {
+        return importOBJ(path, defaultColor, mesh);
+    }
+    if (endsWith(path, ".ply"))
+    {
+        return importPLY(path, defaultColor, mesh);
+    }
+
+    cerr << path << ": unknown mesh file type, expected .obj or .ply" << endl;
+    return false;
+}
+
+bool isMeshFileName(const string &path)
+{
+    return endsWith(path, ".obj") || endsWith(path, ".ply");
+}
+
+static void addVertex(ImportedMesh &mesh, double x, double y, double z, const Color &color)
+{
+    mesh.vertices.push_back(Vec3(x, y, z, mesh.vertices.size() + 1));
+    mesh.colors.push_back(color);
+}
+
+// splits polygon v[0..n) into a fan of triangles
+static void addPolygon(ImportedMesh &mesh, const int *v, int n)
+{
+    for (int i = 2; i < n; i++)
+    {
+        mesh.triangles.push_back(Triangle(v[0], v[i - 1], v[i]));
+    }
+}
+
+/*
+ * Wavefront OBJ
+ */
+
+static inline bool isLineSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+ * Handles one NUL terminated line. Only "v" and "f" records matter, the
+ * rest (normals, texture coordinates, groups, materials) is skipped.
+ */
+static void parseOBJLine(char *line, const Color &defaultColor, ImportedMesh &mesh, vector<int> &polygon)
+{
+    while (isLineSpace(*line))
+    {
+        line++;
+    }
+
+    if (line[0] == 'v' && isLineSpace(line[1]))
+    {
+        double values[6];
+        char *p = line + 1;
+        int count = 0;
+
+        while (count < 6)
+        {
+            char *next;
+            values[count] = strtod(p, &next);
+            if (next == p)
+            {
+                break;
+            }
+            p = next;
+            count++;
+        }
+
+        // the common vertex color extension stores colors in [0, 1]
+        if (count >= 6)
+        {
+            mesh.hasColors = true;
+            addVertex(mesh, values[0], values[1], values[2], Color(values[3] * 255, values[4] * 255, values[5] * 255));
+        }
+        else
+        {
+            for (int i = count; i < 3; i++)
+            {
+                values[i] = 0;
+            }
+            addVertex(mesh, values[0], values[1], values[2], defaultColor);
+        }
+    }
+    else if (line[0] == 'f' && isLineSpace(line[1]))
+    {
+        char *p = line + 1;
+        polygon.clear();
+
+        while (true)
+        {
+            while (isLineSpace(*p))
+            {
+                p++;
+            }
+
+            char *next;
+            long index = strtol(p, &next, 10);
+            if (next == p)
+            {
+                break;
+            }
+
+            // negative indices count back from the last vertex read so far
+            if (index < 0)
+            {
+                index += mesh.vertices.size() + 1;
+            }
+            polygon.push_back(index);
+
+            // skip the texture coordinate and normal indices of "v/vt/vn"
+            p = next;
+            while (*p != '\0' && !isLineSpace(*p))
+            {
+                p++;
+            }
+        }
+
+        addPolygon(mesh, polygon.data(), polygon.size());
+    }
+}
+
+/*
+ * Reads the file in fixed size chunks, so only one chunk of text is held
+ * in memory at a time. A line cut by the end of a chunk is moved to the
+ * front of the buffer and completed by the next read.
+ */
+bool importOBJ(const string &path, const Color &defaultColor, ImportedMesh &mesh)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+    {
+        cerr << path << ": cannot open mesh file" << endl;
+        return false;
+    }
+
+    vector<char> buffer(OBJ_CHUNK_SIZE + 1);
+    vector<int> polygon;
+    size_t kept = 0;
+    bool done = false;
+
+    while (!done)
+    {
+        // a single line longer than the buffer makes it grow
+        if (kept == buffer.size() - 1)
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        size_t read = fread(&buffer[kept], 1, buffer.size() - 1 - kept, file);
+        size_t end = kept + read;
+        done = read == 0;
+
+        // the last line of the file may have no newline
+        size_t complete = end;
+        if (!done)
+        {
+            while (complete > 0 && buffer[complete - 1] != '\n')
+            {
+                complete--;
+            }
+        }
+
+        char *line = &buffer[0];
+        char *stop = &buffer[0] + complete;
+        buffer[end] = '\0';
+
+        while (line < stop)
+        {
+            char *newline = (char *)memchr(line, '\n', stop - line);
+            char *lineEnd = newline != NULL ? newline : stop;
+            char saved = *lineEnd;
+
+            *lineEnd = '\0';
+            parseOBJLine(line, defaultColor, mesh, polygon);
+            *lineEnd = saved;
+
+            line = lineEnd + 1;
+        }
+
+        kept = end - complete;
+        memmove(&buffer[0], &buffer[complete], kept);
+    }
+
+    bool failed = ferror(file) != 0;
+    fclose(file);
+
+    if (failed)
+    {
+        cerr << path << ": read error" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * PLY
+ */
+
+class PLYProperty
+{
+public:
+    string name;
+    int type;      // one of the PLY_* scalar types below
+    int countType; // type of the list length, -1 when the property is not a list
+};
+
+class PLYElement
+{
+public:
+    string name;
+    long count;
+    vector<PLYProperty> properties;
+};
+
+enum
+{
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+static const int plyTypeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+static int plyType(const string &name)
+{
+    const char *names[][2] = {{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+                              {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (name == names[i][0] || name == names[i][1])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Reads values of the body one by one from either encoding. For binary
+ * bodies the whole body is in memory, so reads are plain loads.
+ */
+class PLYReader
+{
+public:
+    const char *p;
+    const char *end;
+    bool ascii;
+    bool swapBytes; // body byte order differs from the machine's
+    bool failed;
+
+    double read(int type)
+    {
+        if (this->ascii)
+        {
+            char *next;
+            double value = strtod(this->p, &next);
+            if (next == this->p)
+            {
+                this->failed = true;
+            }
+            this->p = next;
+            return value;
+        }
+
+        int size = plyTypeSizes[type];
+        if (this->end - this->p < size)
+        {
+            this->failed = true;
+            this->p = this->end;
+            return 0;
+        }
+
+        unsigned char bytes[8];
+        for (int i = 0; i < size; i++)
+        {
+            bytes[i] = this->p[this->swapBytes ? size - 1 - i : i];
+        }
+        this->p += size;
+
+        return decode(bytes, type);
+    }
+
+    static double decode(const unsigned char *bytes, int type)
+    {
+        switch (type)
+        {
+        case PLY_INT8: { signed char v; memcpy(&v, bytes, 1); return v; }
+        case PLY_UINT8: return bytes[0];
+        case PLY_INT16: { short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_UINT16: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_INT32: { int v; memcpy(&v, bytes, 4); return v; }
+        case PLY_UINT32: { unsigned int v; memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+        default: { double v; memcpy(&v, bytes, 8); return v; }
+        }
+    }
+};
+
+static bool readPLYHeader(FILE *file, vector<PLYElement> &elements, string &format)
+{
+    char line[1024];
+
+    if (fgets(line, sizeof(line), file) == NULL || strncmp(line, "ply", 3) != 0)
+    {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char word[256], type[256], countType[256], name[256];
+
+        if (strncmp(line, "end_header", 10) == 0)
+        {
+            // elements without properties would take no space in the body whatever their count
+            for (size_t i = 0; i < elements.size(); i++)
+            {
+                if (elements[i].count < 0 || (elements[i].count > 0 && elements[i].properties.empty()))
+                {
+                    return false;
+                }
+            }
+            return !format.empty();
+        }
+        else if (sscanf(line, "format %255s", word) == 1)
+        {
+            format = word;
+        }
+        else if (sscanf(line, "element %255s %255s", name, word) == 2)
+        {
+            PLYElement element;
+            element.name = name;
+            element.count = strtol(word, NULL, 10);
+            elements.push_back(element);
+        }
+        else if (sscanf(line, "property list %255s %255s %255s", countType, type, name) == 3)
+        {
+            PLYProperty property;
+            property.name = name;
+            property.type = plyType(type);
+            property.countType = plyType(countType);
+
+            if (elements.empty() || property.type < 0 || property.countType < 0)
+            {
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+        else if (sscanf(line, "property %255s %255s", type, name) == 2)
+        {
+            PLYProperty property;
+            property.name = name;
+            property.type = plyType(type);
+            property.countType = -1;
+
+            if (elements.empty() || property.type < 0)
+            {
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+        // comment and obj_info lines are skipped
+    }
+
+    return false;
+}
+
+static int findProperty(const PLYElement &element, const char *name, const char *alternative)
+{
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        if (element.properties[i].name == name || element.properties[i].name == alternative)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Number of elements the rest of a binary body can hold at most, with
+ * every list empty. ASCII values have no fixed size, so nothing is
+ * reserved for them and the body is read until it ends.
+ */
+static long plyElementCapacity(const PLYReader &reader, const PLYElement &element)
+{
+    if (reader.ascii)
+    {
+        return 0;
+    }
+
+    long size = 0;
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        const PLYProperty &property = element.properties[i];
+        size += plyTypeSizes[property.countType >= 0 ? property.countType : property.type];
+    }
+    return (reader.end - reader.p) / size;
+}
+
+static void readPLYVertices(PLYReader &reader, const PLYElement &element, const Color &defaultColor, ImportedMesh &mesh)
+{
+    int x = findProperty(element, "x", "x");
+    int y = findProperty(element, "y", "y");
+    int z = findProperty(element, "z", "z");
+    int rgb[3] = {findProperty(element, "red", "diffuse_red"),
+                  findProperty(element, "green", "diffuse_green"),
+                  findProperty(element, "blue", "diffuse_blue")};
+
+    mesh.hasColors = rgb[0] >= 0 && rgb[1] >= 0 && rgb[2] >= 0;
+
+    // integer colors are already in [0, 255], floating point ones in [0, 1]
+    double colorScale = 1;
+    if (mesh.hasColors && element.properties[rgb[0]].type >= PLY_FLOAT32)
+    {
+        colorScale = 255;
+    }
+
+    size_t propertyCount = element.properties.size();
+    vector<double> values(propertyCount, 0);
+
+    // a count the body cannot hold is an error, not an allocation
+    long capacity = plyElementCapacity(reader, element);
+    if (!reader.ascii && element.count > capacity)
+    {
+        reader.failed = true;
+        return;
+    }
+
+    mesh.vertices.reserve(mesh.vertices.size() + min(element.count, capacity));
+    mesh.colors.reserve(mesh.colors.size() + min(element.count, capacity));
+
+    for (long n = 0; n < element.count && !reader.failed; n++)
+    {
+        for (size_t i = 0; i < propertyCount; i++)
+        {
+            const PLYProperty &property = element.properties[i];
+
+            if (property.countType >= 0)
+            {
+                // lists on vertices (rare) are read and dropped
+                long length = reader.read(property.countType);
+                for (long k = 0; k < length && !reader.failed; k++)
+                {
+                    reader.read(property.type);
+                }
+                values[i] = 0;
+            }
+            else
+            {
+                values[i] = reader.read(property.type);
+            }
+        }
+
+        Color color = defaultColor;
+        if (mesh.hasColors)
+        {
+            color = Color(values[rgb[0]] * colorScale, values[rgb[1]] * colorScale, values[rgb[2]] * colorScale);
+        }
+
+        addVertex(mesh, x >= 0 ? values[x] : 0, y >= 0 ? values[y] : 0, z >= 0 ? values[z] : 0, color);
+    }
+}
+
+static void readPLYFaces(PLYReader &reader, const PLYElement &element, long firstVertex, ImportedMesh &mesh)
+{
+    int indices = findProperty(element, "vertex_indices", "vertex_index");
+    vector<int> polygon;
+
+    long capacity = plyElementCapacity(reader, element);
+    if (!reader.ascii && element.count > capacity)
+    {
+        reader.failed = true;
+        return;
+    }
+
+    mesh.triangles.reserve(mesh.triangles.size() + min(element.count, capacity));
+
+    for (long n = 0; n < element.count && !reader.failed; n++)
+    {
+        for (size_t i = 0; i < element.properties.size(); i++)
+        {
+            const PLYProperty &property = element.properties[i];
+
+            if (property.countType < 0)
+            {
+                reader.read(property.type);
+                continue;
+            }
+
+            long length = reader.read(property.countType);
+            if ((int)i == indices)
+            {
+                polygon.clear();
+            }
+
+            for (long k = 0; k < length && !reader.failed; k++)
+            {
+                double index = reader.read(property.type);
+
+                // PLY indices start from 0
+                if ((int)i == indices)
+                {
+                    polygon.push_back(firstVertex + (long)index + 1);
+                }
+            }
+
+            if ((int)i == indices)
+            {
+                addPolygon(mesh, polygon.data(), polygon.size());
+            }
+        }
+    }
+}
+
+static void skipPLYElement(PLYReader &reader, const PLYElement &element)
+{
+    for (long n = 0; n < element.count && !reader.failed; n++)
+    {
+        for (size_t i = 0; i < element.properties.size(); i++)
+        {
+            const PLYProperty &property = element.properties[i];
+            long length = 1;
+
+            if (property.countType >= 0)
+            {
+                length = reader.read(property.countType);
+            }
+            for (long k = 0; k < length && !reader.failed; k++)
+            {
+                reader.read(property.type);
+            }
+        }
+    }
+}
+
+/*
+ * The body after the header is taken in with a single bulk read and then
+ * decoded element by element. Vertex and face elements are used, any
+ * other element is skipped.
+ */
+bool importPLY(const string &path, const Color &defaultColor, ImportedMesh &mesh)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+    {
+        cerr << path << ": cannot open mesh file" << endl;
+        return false;
+    }
+
+    vector<PLYElement> elements;
+    string format;
+
+    if (!readPLYHeader(file, elements, format))
+    {
+        cerr << path << ": malformed PLY header" << endl;
+        fclose(file);
+        return false;
+    }
+
+    long bodyStart = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long bodySize = ftell(file) - bodyStart;
+    fseek(file, bodyStart, SEEK_SET);
+
+    vector<char> body(bodySize + 1);
+    size_t read = fread(&body[0], 1, bodySize, file);
+    body[read] = '\0';
+    fclose(file);
+
+    unsigned short probe = 1;
+    bool littleEndianMachine = *(unsigned char *)&probe == 1;
+
+    PLYReader reader;
+    reader.p = &body[0];
+    reader.end = &body[0] + read;
+    reader.ascii = format == "ascii";
+    reader.swapBytes = (format == "binary_little_endian") != littleEndianMachine;
+    reader.failed = false;
+
+    if (!reader.ascii && format != "binary_little_endian" && format != "binary_big_endian")
+    {
+        cerr << path << ": unknown PLY format " << format << endl;
+        return false;
+    }
+
+    long firstVertex = mesh.vertices.size();
+
+    for (size_t e = 0; e < elements.size() && !reader.failed; e++)
+    {
+        if (elements[e].name == "vertex")
+        {
+            readPLYVertices(reader, elements[e], defaultColor, mesh);
+        }
+        else if (elements[e].name == "face")
+        {
+            readPLYFaces(reader, elements[e], firstVertex, mesh);
+        }
+        else
+        {
+            skipPLYElement(reader, elements[e]);
+        }
+    }
+
+    if (reader.failed)
+    {
+        cerr << path << ": PLY body is shorter than its header says" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Binary STL
+ */
+
+#define STL_HEADER_SIZE 84
+#define STL_TRIANGLE_SIZE 50
+
+static inline unsigned int littleEndian32(const unsigned char *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+static inline double littleEndianFloat(const unsigned char *bytes)
+{
+    unsigned int bits = littleEndian32(bytes);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+STLReader::STLReader()
+{
+    this->triangleCount = 0;
+    this->file = NULL;
+}
+
+STLReader::~STLReader()
+{
+    close();
+}
+
+bool STLReader::open(const string &path)
+{
+    close();
+
+    this->file = fopen(path.c_str(), "rb");
+    if (this->file == NULL)
+    {
+        cerr << path << ": cannot open mesh file" << endl;
+        return false;
+    }
+
+    // 80 byte comment followed by the triangle count
+    unsigned char header[STL_HEADER_SIZE];
+    if (fread(header, 1, STL_HEADER_SIZE, this->file) != STL_HEADER_SIZE)
+    {
+        cerr << path << ": not a binary STL file" << endl;
+        close();
+        return false;
+    }
+
+    this->triangleCount = littleEndian32(header + 80);
+    return true;
+}
+
+int STLReader::readChunk(int maxTriangles, const Color &defaultColor, vector<Vec3> &corners, vector<Color> &colors)
+{
+    corners.clear();
+    colors.clear();
+
+    if (this->file == NULL)
+    {
+        return 0;
+    }
+
+    this->buffer.resize((size_t)maxTriangles * STL_TRIANGLE_SIZE);
+    int count = fread(&this->buffer[0], STL_TRIANGLE_SIZE, maxTriangles, this->file);
+
+    for (int i = 0; i < count; i++)
+    {
+        // the facet normal in the first 12 bytes is not used
+        const unsigned char *facet = &this->buffer[(size_t)i * STL_TRIANGLE_SIZE];
+
+        for (int k = 0; k < 3; k++)
+        {
+            const unsigned char *corner = facet + 12 + k * 12;
+            corners.push_back(Vec3(littleEndianFloat(corner), littleEndianFloat(corner + 4), littleEndianFloat(corner + 8), -1));
+        }
+
+        unsigned int attribute = facet[48] | (facet[49] << 8);
+        if (attribute & 0x8000)
+        {
+            colors.push_back(Color(((attribute >> 10) & 31) * 255 / 31.0,
+                                   ((attribute >> 5) & 31) * 255 / 31.0,
+                                   (attribute & 31) * 255 / 31.0));
+        }
+        else
+        {
+            colors.push_back(defaultColor);
+        }
+    }
+
+    return count;
+}
+
+void STLReader::close()
+{
+    if (this->file != NULL)
+    {
+        fclose(this->file);
+        this->file = NULL;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __MESH_IMPORTER_H__
+#define __MESH_IMPORTER_H__
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Color.h"
+#include "Triangle.h"
+#include "Vec3.h"
+
+using namespace std;
+
+/*
+ * Geometry read from an external mesh file. Vertex ids in triangles and
+ * color ids in vertices are 1-based and local to the file, the same way
+ * the XML input numbers them.
+ */
+class ImportedMesh
+{
+public:
+    vector<Vec3> vertices;
+    vector<Color> colors; // one per vertex
+    vector<Triangle> triangles;
+    bool hasColors; // false when the file has no vertex colors, colors then hold the default
+
+    ImportedMesh();
+};
+
+/*
+ * Reads a Wavefront OBJ (.obj) or PLY (.ply, ascii or binary) file into mesh,
+ * chosen by the file extension. Polygons are split into triangle fans.
+ * Vertices without a color get defaultColor. Returns false and prints the
+ * reason when the file cannot be read.
+ */
+bool importMeshFile(const string &path, const Color &defaultColor, ImportedMesh &mesh);
+
+// true when path has an extension importMeshFile reads
+bool isMeshFileName(const string &path);
+
+bool importOBJ(const string &path, const Color &defaultColor, ImportedMesh &mesh);
+bool importPLY(const string &path, const Color &defaultColor, ImportedMesh &mesh);
+
+/*
+ * Reads the triangles of a binary STL file one chunk at a time, so that
+ * meshes larger than memory can be rendered without loading them. Facet
+ * colors use the VisCAM/SolidView convention (bit 15 set, 5 bits per
+ * channel, red highest); facets without one get defaultColor.
+ */
+class STLReader
+{
+public:
+    long triangleCount; // from the file header
+
+    STLReader();
+    ~STLReader();
+
+    STLReader(const STLReader &other) = delete;
+    STLReader &operator=(const STLReader &other) = delete;
+
+    // opens path and reads its header, returns false and prints the reason on failure
+    bool open(const string &path);
+
+    /*
+     * Reads up to maxTriangles triangles with a single read, replacing the
+     * contents of corners (three per triangle) and colors (one per
+     * triangle). Returns the number of triangles read, 0 at the end.
+     */
+    int readChunk(int maxTriangles, const Color &defaultColor, vector<Vec3> &corners, vector<Color> &colors);
+
+    void close();
+
+private:
+    FILE *file;
+    vector<unsigned char> buffer;
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "Helpers.h"
+#include "MeshSimplifier.h"
+
+using namespace std;
+
+/*
+ * Sum of squared distances to a set of planes, stored as the upper half of
+ * the symmetric 4x4 matrix (n, d)(n, d)^T.
+ */
+class Quadric
+{
+public:
+    double a[10];
+
+    Quadric()
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            a[i] = 0;
+        }
+    }
+
+    void addPlane(double nx, double ny, double nz, double d)
+    {
+        a[0] += nx * nx; a[1] += nx * ny; a[2] += nx * nz; a[3] += nx * d;
+        a[4] += ny * ny; a[5] += ny * nz; a[6] += ny * d;
+        a[7] += nz * nz; a[8] += nz * d;
+        a[9] += d * d;
+    }
+
+    void add(const Quadric &other)
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            a[i] += other.a[i];
+        }
+    }
+
+    double error(const Vec3 &p) const
+    {
+        return a[0] * p.x * p.x + 2 * a[1] * p.x * p.y + 2 * a[2] * p.x * p.z + 2 * a[3] * p.x +
+               a[4] * p.y * p.y + 2 * a[5] * p.y * p.z + 2 * a[6] * p.y +
+               a[7] * p.z * p.z + 2 * a[8] * p.z +
+               a[9];
+    }
+};
+
+// collapse of vertex from onto vertex to, valid while neither vertex changed
+class Collapse
+{
+public:
+    double cost;
+    int from, to;
+    int fromVersion, toVersion;
+
+    bool operator<(const Collapse &other) const
+    {
+        return cost > other.cost; // cheapest on top of the priority queue
+    }
+};
+
+class Corners
+{
+public:
+    int v[3]; // local vertices of a triangle
+
+    int &operator[](int k) { return v[k]; }
+    const int &operator[](int k) const { return v[k]; }
+};
+
+class Simplifier
+{
+public:
+    vector<Vec3> positions;
+    vector<int> ids; // scene vertex id of every local vertex
+    vector<Corners> corners;
+    vector<bool> alive;
+    vector< vector<int> > trianglesOf; // triangles around each vertex, dead ones included
+    vector<Quadric> quadrics;
+    vector<int> versions;
+    priority_queue<Collapse> queue;
+    int aliveCount;
+    double maxCost;
+
+    Simplifier(const vector<Vec3 *> &vertices, const vector<Triangle> &triangles)
+    {
+        unordered_map<int, int> localIds;
+
+        for (int t = 0; t < triangles.size(); t++)
+        {
+            Corners c;
+            for (int k = 0; k < 3; k++)
+            {
+                int id = triangles[t].vertexIds[k];
+                unordered_map<int, int>::iterator found = localIds.find(id);
+
+                if (found == localIds.end())
+                {
+                    found = localIds.insert(make_pair(id, (int)ids.size())).first;
+                    ids.push_back(id);
+                    positions.push_back(*vertices[id - 1]);
+                    trianglesOf.push_back(vector<int>());
+                }
+                c[k] = found->second;
+                trianglesOf[c[k]].push_back(t);
+            }
+            corners.push_back(c);
+        }
+
+        alive.assign(corners.size(), true);
+        aliveCount = corners.size();
+        quadrics.assign(ids.size(), Quadric());
+        versions.assign(ids.size(), 0);
+        maxCost = 0;
+
+        addFaceQuadrics();
+        addBoundaryQuadrics();
+
+        for (int t = 0; t < corners.size(); t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                // every interior edge is pushed twice, stale copies are dropped later
+                pushEdge(corners[t][k], corners[t][(k + 1) % 3]);
+            }
+        }
+    }
+
+    // collapses edges until at most target triangles are left, false when stuck
+    bool simplify(int target)
+    {
+        while (aliveCount > target)
+        {
+            if (queue.empty())
+            {
+                return false;
+            }
+
+            Collapse collapse = queue.top();
+            queue.pop();
+
+            if (versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion)
+            {
+                continue;
+            }
+
+            if (!flipsTriangle(collapse.from, collapse.to))
+            {
+                apply(collapse);
+            }
+        }
+        return true;
+    }
+
+    void collect(vector<Triangle> &triangles)
+    {
+        triangles.clear();
+        for (int t = 0; t < corners.size(); t++)
+        {
+            if (alive[t])
+            {
+                triangles.push_back(Triangle(ids[corners[t][0]], ids[corners[t][1]], ids[corners[t][2]]));
+            }
+        }
+    }
+
+private:
+    Vec3 faceNormal(int t)
+    {
+        Vec3 &p0 = positions[corners[t][0]];
+        return crossProductVec3(subtractVec3(positions[corners[t][1]], p0), subtractVec3(positions[corners[t][2]], p0));
+    }
+
+    void addFaceQuadrics()
+    {
+        for (int t = 0; t < corners.size(); t++)
+        {
+            Vec3 n = faceNormal(t);
+            if (magnitudeOfVec3(n) < EPSILON)
+            {
+                continue;
+            }
+            n = normalizeVec3(n);
+
+            double d = -dotProductVec3(n, positions[corners[t][0]]);
+            for (int k = 0; k < 3; k++)
+            {
+                quadrics[corners[t][k]].addPlane(n.x, n.y, n.z, d);
+            }
+        }
+    }
+
+    // planes through open edges, perpendicular to their face, keep borders in place
+    void addBoundaryQuadrics()
+    {
+        unordered_map<long long, int> edgeUses;
+        long long stride = ids.size();
+
+        for (int t = 0; t < corners.size(); t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                int a = corners[t][k], b = corners[t][(k + 1) % 3];
+                edgeUses[min(a, b) * stride + max(a, b)]++;
+            }
+        }
+
+        for (int t = 0; t < corners.size(); t++)
+        {
+            Vec3 n = faceNormal(t);
+            if (magnitudeOfVec3(n) < EPSILON)
+            {
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                int a = corners[t][k], b = corners[t][(k + 1) % 3];
+                if (edgeUses[min(a, b) * stride + max(a, b)] != 1)
+                {
+                    continue;
+                }
+
+                Vec3 edge = subtractVec3(positions[b], positions[a]);
+                Vec3 side = crossProductVec3(edge, n);
+                if (magnitudeOfVec3(side) < EPSILON)
+                {
+                    continue;
+                }
+                side = normalizeVec3(side);
+
+                double d = -dotProductVec3(side, positions[a]);
+                quadrics[a].addPlane(side.x, side.y, side.z, d);
+                quadrics[b].addPlane(side.x, side.y, side.z, d);
+            }
+        }
+    }
+
+    void pushEdge(int a, int b)
+    {
+        Quadric q = quadrics[a];
+        q.add(quadrics[b]);
+
+        // the cheaper direction, onto the vertex that stays
+        double ontoB = q.error(positions[b]);
+        double ontoA = q.error(positions[a]);
+
+        Collapse collapse;
+        collapse.cost = max(0.0, min(ontoA, ontoB));
+        collapse.from = ontoB <= ontoA ? a : b;
+        collapse.to = ontoB <= ontoA ? b : a;
+        collapse.fromVersion = versions[collapse.from];
+        collapse.toVersion = versions[collapse.to];
+        queue.push(collapse);
+    }
+
+    // moving from onto to must not turn any remaining triangle around
+    bool flipsTriangle(int from, int to)
+    {
+        for (int i = 0; i < trianglesOf[from].size(); i++)
+        {
+            int t = trianglesOf[from][i];
+            if (!alive[t] || corners[t][0] == to || corners[t][1] == to || corners[t][2] == to)
+            {
+                continue;
+            }
+
+            Vec3 moved[3];
+            for (int k = 0; k < 3; k++)
+            {
+                moved[k] = positions[corners[t][k] == from ? to : corners[t][k]];
+            }
+
+            Vec3 before = faceNormal(t);
+            Vec3 after = crossProductVec3(subtractVec3(moved[1], moved[0]), subtractVec3(moved[2], moved[0]));
+
+            if (dotProductVec3(before, after) <= 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void apply(const Collapse &collapse)
+    {
+        int from = collapse.from, to = collapse.to;
+
+        for (int i = 0; i < trianglesOf[from].size(); i++)
+        {
+            int t = trianglesOf[from][i];
+            if (!alive[t])
+            {
+                continue;
+            }
+
+            if (corners[t][0] == to || corners[t][1] == to || corners[t][2] == to)
+            {
+                alive[t] = false;
+                aliveCount--;
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                if (corners[t][k] == from)
+                {
+                    corners[t][k] = to;
+                }
+            }
+            trianglesOf[to].push_back(t);
+        }
+
+        trianglesOf[from].clear();
+        quadrics[to].add(quadrics[from]);
+        versions[from]++;
+        versions[to]++;
+        maxCost = max(maxCost, collapse.cost);
+
+        // edges around the kept vertex changed cost
+        for (int i = 0; i < trianglesOf[to].size(); i++)
+        {
+            int t = trianglesOf[to][i];
+            if (!alive[t])
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                if (corners[t][k] != to)
+                {
+                    pushEdge(to, corners[t][k]);
+                }
+            }
+        }
+    }
+};
+
+void buildLevelsOfDetail(const vector<Vec3 *> &vertices, const vector<Triangle> &triangles,
+                         int levelCount, double ratio,
+                         vector< vector<Triangle> > &levels, vector<double> &errors)
+{
+    levels.clear();
+    errors.clear();
+
+    Simplifier simplifier(vertices, triangles);
+    int target = triangles.size();
+
+    for (int level = 0; level < levelCount; level++)
+    {
+        target = (int)(target * ratio);
+        int before = simplifier.aliveCount;
+
+        bool reached = simplifier.simplify(target);
+        if (simplifier.aliveCount == before)
+        {
+            break;
+        }
+
+        levels.push_back(vector<Triangle>());
+        simplifier.collect(levels.back());
+        errors.push_back(sqrt(simplifier.maxCost));
+
+        if (!reached)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+#include <vector>
+#include "Triangle.h"
+#include "Vec3.h"
+
+using namespace std;
+
+/*
+ * Builds up to levelCount coarser versions of triangles by quadric error
+ * edge collapse. Each level has about ratio times the triangles of the one
+ * before it. Collapses move a vertex onto a neighbouring vertex, so levels
+ * use the existing vertex ids (and colors) of the scene.
+ * errors[l] is the geometric error of levels[l] in model units, the square
+ * root of the largest quadric error of a collapse made so far. Building
+ * stops early when no further collapse is possible.
+ */
+void buildLevelsOfDetail(const vector<Vec3 *> &vertices, const vector<Triangle> &triangles,
+                         int levelCount, double ratio,
+                         vector< vector<Triangle> > &levels, vector<double> &errors);
+
+#endif
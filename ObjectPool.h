@@ -0,0 +1,106 @@
+#ifndef __OBJECT_POOL_H__
+#define __OBJECT_POOL_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+    Typed bump allocator. Objects are constructed back to back in large
+    blocks and all of them are destroyed together with the pool.
+    Pointers stay valid for the lifetime of the pool, objects are never
+    moved or freed individually.
+*/
+template <typename T>
+class ObjectPool
+{
+public:
+    ObjectPool()
+    {
+        this->count = 0;
+    }
+
+    ~ObjectPool()
+    {
+        for (size_t i = 0; i < this->blocks.size(); i++)
+        {
+            T *objects = (T *)this->blocks[i].storage;
+
+            for (size_t j = 0; j < this->blocks[i].used; j++)
+            {
+                objects[j].~T();
+            }
+
+            ::operator delete(this->blocks[i].storage);
+        }
+    }
+
+    ObjectPool(const ObjectPool &other) = delete;
+    ObjectPool &operator=(const ObjectPool &other) = delete;
+
+    /*
+        Constructs a new object in the pool with the given constructor arguments.
+    */
+    template <typename... Args>
+    T *create(Args &&... args)
+    {
+        if (this->blocks.empty() || this->blocks.back().used == this->blocks.back().capacity)
+        {
+            // blocks double in size, starting from 64 even after a small reserve
+            size_t capacity = this->blocks.empty() ? 64 : max(this->blocks.back().capacity * 2, (size_t)64);
+            addBlock(capacity);
+        }
+
+        Block &block = this->blocks.back();
+        T *object = new ((T *)block.storage + block.used) T(std::forward<Args>(args)...);
+
+        block.used++;
+        this->count++;
+
+        return object;
+    }
+
+    /*
+        Makes sure the next n objects are laid out in a single block,
+        reserving none does nothing.
+    */
+    void reserve(size_t n)
+    {
+        if (n > 0 && (this->blocks.empty() || this->blocks.back().capacity - this->blocks.back().used < n))
+        {
+            addBlock(n);
+        }
+    }
+
+    size_t size() const
+    {
+        return this->count;
+    }
+
+private:
+    struct Block
+    {
+        void *storage;
+        size_t capacity;
+        size_t used;
+    };
+
+    vector<Block> blocks;
+    size_t count;
+
+    void addBlock(size_t capacity)
+    {
+        Block block;
+        block.storage = ::operator new(capacity * sizeof(T));
+        block.capacity = capacity;
+        block.used = 0;
+
+        this->blocks.push_back(block);
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <iomanip>
+#include <iostream>
+#include "RenderStats.h"
+
+using namespace std;
+
+RenderStats::RenderStats()
+{
+    reset();
+}
+
+void RenderStats::reset()
+{
+    trianglesIn = 0;
+    lodTrianglesSaved = 0;
+    trianglesCulled = 0;
+    trianglesProjected = 0;
+    meshesOccluded = 0;
+    trianglesOccluded = 0;
+    fragmentsShaded = 0;
+    fragmentsPrepassed = 0;
+    threadBusyMs.clear();
+    threadIdleMs.clear();
+}
+
+void RenderStats::print(ostream &os) const
+{
+    os << "\ttriangles: " << trianglesIn << " in, "
+       << lodTrianglesSaved << " saved by level of detail, "
+       << trianglesCulled << " culled, "
+       << trianglesProjected << " projected" << endl
+       << "\tocclusion: " << meshesOccluded << " meshes, " << trianglesOccluded << " triangles culled" << endl
+       << "\tfragments: " << fragmentsShaded << " shaded, " << fragmentsPrepassed << " depth prepassed" << endl;
+
+    // the caller's number format is put back afterwards
+    ios::fmtflags flags = os.flags();
+    streamsize precision = os.precision();
+
+    for (int t = 0; t < threadBusyMs.size(); t++)
+    {
+        os << "\tthread " << t << ": " << fixed << setprecision(2)
+           << threadBusyMs[t] << " ms busy, " << threadIdleMs[t] << " ms idle" << endl;
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
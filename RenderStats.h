@@ -0,0 +1,38 @@
+#ifndef __RENDER_STATS_H__
+#define __RENDER_STATS_H__
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/*
+    Counters of the work done for one camera image. Streamed meshes are
+    not counted.
+*/
+class RenderStats
+{
+public:
+    // reset when the geometry is projected
+    long trianglesIn;        // triangles of the meshes at full detail
+    long lodTrianglesSaved;  // left out by drawing a coarser level of detail
+    long trianglesCulled;    // back-facing or degenerate
+    long trianglesProjected; // kept for rasterization
+
+    // reset when the projected geometry is rasterized
+    long meshesOccluded;     // skipped by occlusion culling
+    long trianglesOccluded;  // projected triangles of those meshes
+    long fragmentsShaded;    // pixels colored, overwritten ones included
+    long fragmentsPrepassed; // covered by the depth prepass
+
+    // per scheduler thread, since the geometry was projected (previews rasterized from it included)
+    vector<double> threadBusyMs; // running tasks
+    vector<double> threadIdleMs; // waiting for tasks while others ran
+
+    RenderStats();
+
+    void reset();
+    void print(ostream &os) const;
+};
+
+#endif
@@ -5,6 +5,10 @@
 #include <fstream>
 #include <cmath>
 #include <map>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
 
 #include "Scene.h"
 #include "Camera.h"
@@ -17,6 +21,9 @@
 #include "Vec3.h"
 #include "tinyxml2.h"
 #include "Helpers.h"
+#include "FaceParser.h"
+#include "MeshImporter.h"
+#include "MeshSimplifier.h"
 
 using namespace tinyxml2;
 using namespace std;
@@ -26,19 +33,27 @@ using namespace std;
 	You may define helper functions.
 */
 
-//From Hw1
-int colorClamp(double &color){
-	if(color > 255)
-		return 255;
-	if(color < 0)
-		return 0;
-	return round(color + 0.5);
+// Shaded colors are stored half a level up, so that clamping and rounding once
+// at output maps them to round(c + 0.5) as clamping every write did
+static inline Color shadedLevel(const Color &color){
+	return Color(color.r + 0.5, color.g + 0.5, color.b + 0.5);
 }
 
-Color colorClamp(Color &color){
-	return Color(colorClamp(color.r), 
-					colorClamp(color.g), 
-					colorClamp(color.b));
+// Samples are also clamped to [0, 255], the resolve averages them and a
+// saturated channel would pull an edge pixel past its covered share
+static inline double sampleLevel(double value){
+	return min(max(value + 0.5, 0.0), 255.0);
+}
+
+static inline Color sampleLevel(const Color &color){
+	return Color(sampleLevel(color.r), sampleLevel(color.g), sampleLevel(color.b));
+}
+
+// color ids past the scene's colors belong to the streamed chunk being drawn
+const Color &Scene::vertexColor(RasterContext &raster, int colorId)
+{
+	int count = colorsOfVertices.size();
+	return colorId <= count ? *colorsOfVertices[colorId - 1] : raster.streamColors[colorId - count - 1];
 }
 
 Matrix4 Scene::getTranslationMatrix(Translation * t) {
@@ -141,10 +156,10 @@ bool isVisible(double den, double num, double &t_e, double &t_l) {
 }
 
 //Liang-Barsky Algorithm
-bool Scene::clipping(Vec4 &vec0, Vec4 &vec1, int nx, int ny){
+bool Scene::clipping(RasterContext &raster, Vec4 &vec0, Vec4 &vec1, int nx, int ny){
 
-	Color color_vec0 = *colorsOfVertices[vec0.colorId-1];
-	Color color_vec1 = *colorsOfVertices[vec1.colorId-1];
+	Color color_vec0 = vertexColor(raster, vec0.colorId);
+	Color color_vec1 = vertexColor(raster, vec1.colorId);
 
 	Vec4 d = subtractVec4(vec1, vec0);
 	Color color_diff = (color_vec1- color_vec0)/d.x;
@@ -152,6 +167,9 @@ bool Scene::clipping(Vec4 &vec0, Vec4 &vec1, int nx, int ny){
 	Vec3 maxVec(nx-0.5, ny-0.5, 1., -1.);
 	double t_e = 0, t_l = 1;
 
+	// addVec4 drops colorId, keep the endpoint colors of the clipped line
+	int color_id0 = vec0.colorId, color_id1 = vec1.colorId;
+
 	bool visible = false;
 
 	if (isVisible(d.x, minVec.x - vec0.x, t_e, t_l))  //left
@@ -163,10 +181,12 @@ bool Scene::clipping(Vec4 &vec0, Vec4 &vec1, int nx, int ny){
 		visible = true;
 		if(t_l < 1){
 			vec1 = addVec4(vec0, multiplyVec4WithScalar(d, t_l));
+			vec1.colorId = color_id1;
 			color_vec1 = color_vec0 + color_diff * t_l;
 		}							
 		if(t_e > 0){
 			vec0 = addVec4(vec0, multiplyVec4WithScalar(d, t_e) );
+			vec0.colorId = color_id0;
 			color_vec0 = color_vec1 + color_diff * t_e;
 		}
 	}
@@ -174,16 +194,28 @@ bool Scene::clipping(Vec4 &vec0, Vec4 &vec1, int nx, int ny){
 	return visible;
 }
 
-bool backFaceCulling(Vec4 &v1, Vec4 &v2, Vec4 &v3){
-	Vec3 v3_v1 = subtractVec3(convertVec3(v3), convertVec3(v1));
-	Vec3 v2_v1 = subtractVec3(convertVec3(v2), convertVec3(v1));
+// Perspective division that leaves 1/w in t, for perspective correct interpolation
+static void divideKeepingInverseW(Vec4 &v)
+{
+	double w = v.t;
+	perspectiveDivision(v);
+	v.t = 1 / w;
+}
 
-	Vec3 normal = normalizeVec3(crossProductVec3(v3_v1, v2_v1));
-	if(dotProductVec3(normal, normalizeVec3(convertVec3(v2))) < 0) 
-		return true;
-	else 
-		return false;
+// Viewport transformation of a vertex holding 1/w in t, which it keeps
+static Vec4 viewportTransform(Matrix4 &Mviewp, Vec4 &v)
+{
+	Vec4 screen(v);
+	screen.t = 1;
+	screen = multiplyMatrixWithVec4(Mviewp, screen);
+	screen.t = v.t;
+	screen.colorId = v.colorId;
+	return screen;
+}
 
+// Twice the signed area of a screen space triangle, positive when counter-clockwise
+double signedArea(Vec4 &v1, Vec4 &v2, Vec4 &v3){
+	return (v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y);
 }
 
 
@@ -290,7 +322,7 @@ for x = x0 to x1 do:
 */
 
 // Modify midpoint algorithms according to slope
-void Scene::lineRasterizer(Vec4 &vec1, Vec4 &vec2)
+void Scene::lineRasterizer(RasterContext &raster, Vec4 &vec1, Vec4 &vec2)
 {
     double dx = vec2.x - vec1.x;
     double dy = vec2.y - vec1.y;
@@ -300,38 +332,199 @@ void Scene::lineRasterizer(Vec4 &vec1, Vec4 &vec2)
 
 		// -1 < slope < 0 
         if (vec2.x < vec1.x) {
-			midpoint1(vec2, vec1);
+			midpoint1(raster, vec2, vec1);
         }
 		// 0 < slope < 1 
 		else{
-			midpoint1(vec1,vec2);
+			midpoint1(raster, vec1,vec2);
 		}
     }
 	// (-inf < slope < -1)  U  (1 < slope < +inf)
     else if (abs(dy) > abs(dx)) {
 		// -inf < slope < -1 
         if (vec2.y < vec1.y) {
-            midpoint2(vec2, vec1);
+            midpoint2(raster, vec2, vec1);
         }
 		// 1 < slope < +inf
 		else{
-			midpoint2(vec1, vec2);
+			midpoint2(raster, vec1, vec2);
 		}
     }
 }
-void Scene::midpoint1(Vec4 &vec1, Vec4 &vec2 ){
+// Every rasterizer writes its pixels through here
+inline void Scene::writePixel(RasterContext &raster, int x, int y, Color &color){
+	if (tiledFramebufferEnabled)
+		tiledImage.at(x - drawXMin, y - drawYMin) = shadedLevel(color);
+	else
+		image[x - drawXMin][y - drawYMin] = shadedLevel(color);
+	raster.fragmentsShaded++;
+
+	if (overdrawEnabled) {
+		overdraw[x - drawXMin][y - drawYMin]++;
+		raster.pixelWrites++;
+	}
+}
+
+// Keeps z at (x, y) and returns true when it is nearer than what was drawn there
+inline bool Scene::depthTest(int x, int y, double z){
+	double &stored = depth[x - drawXMin][y - drawYMin];
+	if (z >= stored)
+		return false;
+
+	stored = z;
+	return true;
+}
+
+// Shading pass after the depth prepass: true for the first fragment at the depth the prepass kept
+inline bool Scene::depthEqualTest(int x, int y, double z){
+	double &stored = depth[x - drawXMin][y - drawYMin];
+	if (z != stored)
+		return false;
+
+	// nearer lines still pass the ordinary test, equally deep fragments no longer match
+	stored = nextafter(z, -numeric_limits<double>::infinity());
+	return true;
+}
+
+/*
+	Multisampled counterpart of writePixel: the samples of (x, y) in mask get
+	color where they pass the depth test, at z plus the depth gradient times
+	their offset. Counts as one fragment when any sample is written.
+*/
+void Scene::writeSamples(RasterContext &raster, int x, int y, unsigned mask, Color &color, double z, double dzdx, double dzdy){
+	size_t first = ((size_t)(x - drawXMin) * (drawYMax - drawYMin) + y - drawYMin) * multisampleCount;
+	Color level = sampleLevel(color);
+	bool written = false;
+
+	for (int s = 0; s < multisampleCount; s++) {
+		if (!(mask & (1u << s)))
+			continue;
+
+		if (depthTestEnabled) {
+			double sampleZ = z + sampleX[s] * dzdx + sampleY[s] * dzdy;
+			double &stored = sampleDepths[first + s];
+
+			if (raster.shadingPass ? sampleZ != stored : sampleZ >= stored)
+				continue;
+			stored = raster.shadingPass ? nextafter(sampleZ, -numeric_limits<double>::infinity()) : sampleZ;
+		}
+
+		sampleColors[first + s] = level;
+		written = true;
+	}
+
+	if (!written)
+		return;
+
+	if (occlusionCullingEnabled)
+		keepFarthestSample(x, y);
+
+	raster.fragmentsShaded++;
+	if (overdrawEnabled) {
+		overdraw[x - drawXMin][y - drawYMin]++;
+		raster.pixelWrites++;
+	}
+}
+
+// The depth pyramid is built from depth, which holds the farthest sample of each pixel
+void Scene::keepFarthestSample(int x, int y){
+	const double *stored = &sampleDepths[((size_t)(x - drawXMin) * (drawYMax - drawYMin) + y - drawYMin) * multisampleCount];
+	double farthest = stored[0];
+
+	for (int s = 1; s < multisampleCount; s++)
+		farthest = max(farthest, stored[s]);
+
+	depth[x - drawXMin][y - drawYMin] = farthest;
+}
+
+/*
+	Multisampled line pixel. The midpoint walk is at (x, y); lines are one
+	pixel wide, so the samples of the pixel and of its two neighbours across
+	the line are covered when they lie within half a pixel of it. from is a
+	point on the line, slope the change of the minor coordinate per major one.
+*/
+void Scene::lineSamples(RasterContext &raster, int x, int y, bool xMajor, Vec4 &from, double slope, Color &color, double z){
+	for (int k = -1; k <= 1; k++) {
+		int px = xMajor ? x : x + k;
+		int py = xMajor ? y + k : y;
+		if (!insideDrawArea(raster, px, py))
+			continue;
+
+		unsigned mask = 0;
+		for (int s = 0; s < multisampleCount; s++) {
+			double major = xMajor ? px + sampleX[s] : py + sampleY[s];
+			double minor = xMajor ? py + sampleY[s] : px + sampleX[s];
+			double onLine = xMajor ? from.y + (major - from.x) * slope : from.x + (major - from.y) * slope;
+
+			if (fabs(minor - onLine) <= 0.5)
+				mask |= 1u << s;
+		}
+
+		if (mask != 0)
+			writeSamples(raster, px, py, mask, color, z, 0, 0);
+	}
+}
+
+// Averages the samples of every pixel into image
+void Scene::resolveSamples(){
+	int height = drawYMax - drawYMin;
+	const Color *samples = sampleColors.data();
+
+	for (int i = 0; i < drawXMax - drawXMin; i++) {
+		for (int j = 0; j < height; j++, samples += multisampleCount) {
+			Color sum = samples[0];
+			for (int s = 1; s < multisampleCount; s++)
+				sum = sum + samples[s];
+
+			image[i][j] = sum / multisampleCount;
+		}
+	}
+}
+
+// The midpoint walk can step one pixel past the clipped range at the line ends.
+// Lines are clipped to the whole image and tested against the scissor per pixel,
+// so a line drawn in pieces under different scissors matches the line drawn at once.
+inline bool Scene::insideDrawArea(RasterContext &raster, int x, int y){
+	return x >= raster.clipXMin && x < raster.clipXMax && y >= raster.clipYMin && y < raster.clipYMax;
+}
+
+/*
+	Restricts rendering to [xMin, xMax) x [yMin, yMax) of the camera image until
+	clearScissor. Takes effect at the next initializeImage, which then allocates
+	an image of the scissor's size only.
+*/
+void Scene::setScissor(int xMin, int yMin, int xMax, int yMax)
+{
+	scissorEnabled = true;
+	scissorXMin = xMin;
+	scissorYMin = yMin;
+	scissorXMax = xMax;
+	scissorYMax = yMax;
+}
+
+void Scene::clearScissor()
+{
+	scissorEnabled = false;
+}
+
+void Scene::midpoint1(RasterContext &raster, Vec4 &vec1, Vec4 &vec2 ){
 	Color c, c1, c2, dc;
-	c1 = *colorsOfVertices[vec1.colorId-1];
-	c2 = *colorsOfVertices[vec2.colorId-1];
+	c1 = vertexColor(raster, vec1.colorId);
+	c2 = vertexColor(raster, vec2.colorId);
 	c = c1;
 	double d;
 	int y = vec1.y;
+	double z = vec1.z, dz = (vec2.z - vec1.z) / (vec2.x - vec1.x);
+	double slope = vec2.x != vec1.x ? (vec2.y - vec1.y) / (vec2.x - vec1.x) : 0;
 
 	if(vec2.y<vec1.y){       
         d = (vec1.y - vec2.y) + ( -0.5 * (vec2.x - vec1.x));
         dc = (c2 - c1) / (vec2.x - vec1.x);
         for (int x = vec1.x; x <= vec2.x; x++) {
-            image[x][y] = colorClamp(c);
+            if (multisampleCount > 1)
+            	lineSamples(raster, x, y, true, vec1, slope, c, z);
+            else if (insideDrawArea(raster, x, y) && (!depthTestEnabled || depthTest(x, y, z)))
+            	writePixel(raster, x, y, c);
            // choose NE
 		   if (d > 0){ 
                 y--;
@@ -342,13 +535,17 @@ void Scene::midpoint1(Vec4 &vec1, Vec4 &vec2 ){
                 d += (vec1.y - vec2.y);
 			} 
             c = c + dc;
+            z += dz;
         }
 	}
 	else{
         d = (vec1.y - vec2.y) + ( 0.5 * (vec2.x - vec1.x));
         dc = (c2 - c1) / (vec2.x - vec1.x);
         for (int x = vec1.x; x <= vec2.x; x++) {
-            image[x][y] = colorClamp(c);
+            if (multisampleCount > 1)
+            	lineSamples(raster, x, y, true, vec1, slope, c, z);
+            else if (insideDrawArea(raster, x, y) && (!depthTestEnabled || depthTest(x, y, z)))
+            	writePixel(raster, x, y, c);
             // choose NE
 			if (d < 0){ 
                 y ++;
@@ -359,23 +556,29 @@ void Scene::midpoint1(Vec4 &vec1, Vec4 &vec2 ){
  				d += (vec1.y - vec2.y);
 			}      
             c = c + dc;
+            z += dz;
         }
 	}
 
 }
-void Scene::midpoint2(Vec4 &vec1, Vec4 &vec2){
+void Scene::midpoint2(RasterContext &raster, Vec4 &vec1, Vec4 &vec2){
 		Color c, c1, c2, dc;
-		c1 = *colorsOfVertices[vec1.colorId-1];
-		c2 = *colorsOfVertices[vec2.colorId-1];
+		c1 = vertexColor(raster, vec1.colorId);
+		c2 = vertexColor(raster, vec2.colorId);
 		c = c1;
 		double d;
         int x = vec1.x;
+		double z = vec1.z, dz = (vec2.z - vec1.z) / (vec2.y - vec1.y);
+		double slope = (vec2.x - vec1.x) / (vec2.y - vec1.y);
 
 		if (vec2.x < vec1.x) {
 			d = (vec2.x - vec1.x) + (-0.5 * (vec1.y - vec2.y));
 			dc = (c2 - c1) / (vec2.y - vec1.y);
 			for (int y = vec1.y; y <= vec2.y; y++) {
-				image[x][y] = colorClamp(c);
+				if (multisampleCount > 1)
+					lineSamples(raster, x, y, false, vec1, slope, c, z);
+				else if (insideDrawArea(raster, x, y) && (!depthTestEnabled || depthTest(x, y, z)))
+					writePixel(raster, x, y, c);
 				if (d < 0){
 					x --;
 					d += (vec2.x - vec1.x) - (vec1.y - vec2.y);
@@ -384,13 +587,17 @@ void Scene::midpoint2(Vec4 &vec1, Vec4 &vec2){
 					d += (vec2.x - vec1.x);
 				}	
 				c = c + dc;
+				z += dz;
 			}
         }
 		else{
 			d = (vec2.x - vec1.x) + (0.5 * (vec1.y - vec2.y));
 			dc = (c2 - c1) / (vec2.y - vec1.y);
 			for (int y = vec1.y; y <= vec2.y; y++) {
-				image[x][y] = colorClamp(c);
+				if (multisampleCount > 1)
+					lineSamples(raster, x, y, false, vec1, slope, c, z);
+				else if (insideDrawArea(raster, x, y) && (!depthTestEnabled || depthTest(x, y, z)))
+					writePixel(raster, x, y, c);
 				if (d > 0){
 					x ++;
 					d += (vec2.x - vec1.x) + (vec1.y - vec2.y);
@@ -399,12 +606,40 @@ void Scene::midpoint2(Vec4 &vec1, Vec4 &vec2){
 					d += (vec2.x - vec1.x);
 				}
 				c = c + dc;
+				z += dz;
 			}
 		}
 
 }
 
-void Scene::triangleRasterizer(Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny)
+/*
+	Setup shared by the triangle kernels. The edge functions (lineEquation of
+	each edge, 0 on the edge and positive inside) are affine in the pixel, so
+	the kernels step them by a constant per pixel instead of evaluating them.
+	Vertices are snapped to 1/256 pixel first: every edge value is then a
+	multiple of 2^-16 and stepping adds no rounding as long as the values
+	fit in the 53 bit mantissa, so pixels on an edge shared by two
+	triangles are covered by both, as with evaluation. Vertices far
+	outside the screen, nearly clipped by the near plane, exceed that and
+	their edges round like any other evaluation would.
+*/
+class TriangleSetup
+{
+public:
+	int iStart, jStart, iEnd, jEnd; // pixels [iStart, iEnd) x [jStart, jEnd)
+	double edge[3]; // at (iStart, jStart), the edge opposite v0, v1 and v2
+	double stepI[3], stepJ[3];
+	double inverseArea;
+};
+
+static double snapToSubpixel(double value)
+{
+	return round(value * 256) / 256;
+}
+
+// pixels whose centers the triangle may cover, false when none of the draw area
+static bool pixelCenterRange(Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny,
+                             int drawXMin, int drawYMin, int drawXMax, int drawYMax, TriangleSetup &setup)
 {
     // Compute the bounding box of the triangle
 	// Adjust max and min values so,  0 <= values <= camera->HorRes, Camera->verRes
@@ -417,39 +652,293 @@ void Scene::triangleRasterizer(Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny)
 	double ymin = yminTemp > ny ? ny-1 : yminTemp;
 	double xmax = xmaxTemp > nx ? nx-1 : xmaxTemp;
 	double ymax = ymaxTemp > ny ? ny-1 : ymaxTemp;
-	 
 
-    // Get the colors of the vertices
-    Color c0(*colorsOfVertices[v0.colorId - 1]);
-    Color c1(*colorsOfVertices[v1.colorId - 1]);
-    Color c2(*colorsOfVertices[v2.colorId - 1]);
+    // Pixels outside the scissor are skipped, the ones inside are computed as without it
+    setup.iStart = max((int)xmin, drawXMin);
+    setup.jStart = max((int)ymin, drawYMin);
+    setup.iEnd = (int)ceil(min(xmax, (double)drawXMax));
+    setup.jEnd = (int)ceil(min(ymax, (double)drawYMax));
+
+    return setup.iStart < setup.iEnd && setup.jStart < setup.jEnd;
+}
+
+// edge functions at the start of the pixel range in setup, false when the triangle is degenerate
+static bool setupEdges(Vec4 &v0, Vec4 &v1, Vec4 &v2, TriangleSetup &setup)
+{
+    double x[3] = {snapToSubpixel(v0.x), snapToSubpixel(v1.x), snapToSubpixel(v2.x)};
+    double y[3] = {snapToSubpixel(v0.y), snapToSubpixel(v1.y), snapToSubpixel(v2.y)};
 
-    // Iterate over the bounding box and draw the triangle
-    for (int i = xmin; i < xmax; i++)
+    for (int k = 0; k < 3; k++)
     {
-        for (int j = ymin; j < ymax; j++)
+        int a = (k + 1) % 3, b = (k + 2) % 3;
+
+        setup.stepI[k] = y[a] - y[b];
+        setup.stepJ[k] = x[b] - x[a];
+        setup.edge[k] = setup.iStart * setup.stepI[k] + setup.jStart * setup.stepJ[k] + (x[a] * y[b] - y[a] * x[b]);
+    }
+
+    double area = x[0] * setup.stepI[0] + y[0] * setup.stepJ[0] + (x[1] * y[2] - y[1] * x[2]);
+    if (area == 0)
+        return false;
+
+    // clockwise triangles have negative edge values inside
+    if (area < 0)
+    {
+        for (int k = 0; k < 3; k++)
         {
-            // Compute the barycentric coordinates of the current point
-            double alpha = lineEquation(i, j, v1.x, v1.y, v2.x, v2.y) / lineEquation(v0.x, v0.y, v1.x, v1.y, v2.x, v2.y);
-            double beta = lineEquation(i, j, v2.x, v2.y, v0.x ,v0.y) / lineEquation(v1.x, v1.y, v2.x, v2.y, v0.x, v0.y);
-            double gamma = lineEquation(i, j, v0.x, v0.y, v1.x, v1.y) / lineEquation(v2.x, v2.y, v0.x, v0.y, v1.x, v1.y);
+            setup.edge[k] = -setup.edge[k];
+            setup.stepI[k] = -setup.stepI[k];
+            setup.stepJ[k] = -setup.stepJ[k];
+        }
+        area = -area;
+    }
+
+    setup.inverseArea = 1 / area;
+    return true;
+}
+
+/*
+	Colors the pixels of a screen space triangle with its vertex colors.
+	Barycentric weights come from the stepped edge functions. Depth is
+	interpolated linearly on screen, colors too unless perspective correct
+	interpolation is enabled: then the weights are scaled by the 1/w each
+	vertex carries in t and renormalized.
+*/
+void Scene::triangleRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny)
+{
+    if (multisampleCount > 1)
+    {
+        triangleSampleRasterizer(raster, v0, v1, v2, false);
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!pixelCenterRange(v0, v1, v2, nx, ny, raster.clipXMin, raster.clipYMin, raster.clipXMax, raster.clipYMax, setup) ||
+        !setupEdges(v0, v1, v2, setup))
+        return;
 
+    // Get the colors of the vertices
+    Color c0(vertexColor(raster, v0.colorId));
+    Color c1(vertexColor(raster, v1.colorId));
+    Color c2(vertexColor(raster, v2.colorId));
+
+    double rowEdge[3] = {setup.edge[0], setup.edge[1], setup.edge[2]};
+
+    for (int i = setup.iStart; i < setup.iEnd; i++)
+    {
+        double e0 = rowEdge[0], e1 = rowEdge[1], e2 = rowEdge[2];
+
+        for (int j = setup.jStart; j < setup.jEnd; j++, e0 += setup.stepJ[0], e1 += setup.stepJ[1], e2 += setup.stepJ[2])
+        {
             // Check if the current point is inside the triangle
-            if (alpha >= 0 && beta >= 0 && gamma >= 0)
+            if (e0 < 0 || e1 < 0 || e2 < 0)
+                continue;
+
+            double alpha = e0 * setup.inverseArea;
+            double beta = e1 * setup.inverseArea;
+            double gamma = e2 * setup.inverseArea;
+
+            if (depthTestEnabled)
+            {
+                double z = alpha * v0.z + beta * v1.z + gamma * v2.z;
+                if (raster.shadingPass ? !depthEqualTest(i, j, z) : !depthTest(i, j, z))
+                    continue;
+            }
+
+            if (perspectiveCorrectEnabled)
+            {
+                alpha *= v0.t;
+                beta *= v1.t;
+                gamma *= v2.t;
+
+                double normalization = 1 / (alpha + beta + gamma);
+                alpha *= normalization;
+                beta *= normalization;
+                gamma *= normalization;
+            }
+
+            // Compute the color of the current point
+            Color color = (c0 * alpha) + (c1 * beta) + (c2 * gamma);
+            writePixel(raster, i, j, color);
+        }
+
+        rowEdge[0] += setup.stepI[0];
+        rowEdge[1] += setup.stepI[1];
+        rowEdge[2] += setup.stepI[2];
+    }
+}
+
+/*
+	Depth prepass kernel: triangleRasterizer's coverage and depth, without
+	colors. Depths are computed exactly as there, so the shading pass finds
+	them equal.
+*/
+void Scene::triangleDepthRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny)
+{
+    if (multisampleCount > 1)
+    {
+        triangleSampleRasterizer(raster, v0, v1, v2, true);
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!pixelCenterRange(v0, v1, v2, nx, ny, raster.clipXMin, raster.clipYMin, raster.clipXMax, raster.clipYMax, setup) ||
+        !setupEdges(v0, v1, v2, setup))
+        return;
+
+    double rowEdge[3] = {setup.edge[0], setup.edge[1], setup.edge[2]};
+
+    for (int i = setup.iStart; i < setup.iEnd; i++)
+    {
+        double e0 = rowEdge[0], e1 = rowEdge[1], e2 = rowEdge[2];
+        vector<double> &column = depth[i - drawXMin];
+
+        for (int j = setup.jStart; j < setup.jEnd; j++, e0 += setup.stepJ[0], e1 += setup.stepJ[1], e2 += setup.stepJ[2])
+        {
+            if (e0 < 0 || e1 < 0 || e2 < 0)
+                continue;
+
+            double alpha = e0 * setup.inverseArea;
+            double beta = e1 * setup.inverseArea;
+            double gamma = e2 * setup.inverseArea;
+            double z = alpha * v0.z + beta * v1.z + gamma * v2.z;
+
+            double &stored = column[j - drawYMin];
+            if (z < stored)
             {
-                // Compute the color of the current point
-                Color color =(c0 * alpha) + (c1 * beta) + (c2 * gamma);
-                image[i][j] = colorClamp(color);
+                stored = z;
             }
+            raster.fragmentsPrepassed++;
         }
+
+        rowEdge[0] += setup.stepI[0];
+        rowEdge[1] += setup.stepI[1];
+        rowEdge[2] += setup.stepI[2];
+    }
+}
+
+/*
+	Multisampled triangle kernel. A pixel is covered by the samples inside
+	the triangle, depth is tested per sample, and the color is shaded once:
+	at the pixel center, or at the first covered sample when the center lies
+	outside, so edges never extrapolate colors. depthOnly fills the sample
+	depths for the depth prepass.
+*/
+void Scene::triangleSampleRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, bool depthOnly)
+{
+    // samples lie up to half a pixel from the centers
+    TriangleSetup setup;
+    setup.iStart = (int)ceil(max(min({v0.x, v1.x, v2.x}) - 0.5, (double)raster.clipXMin));
+    setup.jStart = (int)ceil(max(min({v0.y, v1.y, v2.y}) - 0.5, (double)raster.clipYMin));
+    setup.iEnd = (int)floor(min(max({v0.x, v1.x, v2.x}) + 0.5, raster.clipXMax - 0.5)) + 1;
+    setup.jEnd = (int)floor(min(max({v0.y, v1.y, v2.y}) + 0.5, raster.clipYMax - 0.5)) + 1;
+
+    if (setup.iStart >= setup.iEnd || setup.jStart >= setup.jEnd || !setupEdges(v0, v1, v2, setup))
+        return;
+
+    Color c0(vertexColor(raster, v0.colorId));
+    Color c1(vertexColor(raster, v1.colorId));
+    Color c2(vertexColor(raster, v2.colorId));
+
+    // edge values and depth at a sample differ from the center by constants
+    double offset[3][8];
+    for (int k = 0; k < 3; k++)
+    {
+        for (int s = 0; s < multisampleCount; s++)
+        {
+            offset[k][s] = sampleX[s] * setup.stepI[k] + sampleY[s] * setup.stepJ[k];
+        }
+    }
+
+    double dzdx = (setup.stepI[0] * v0.z + setup.stepI[1] * v1.z + setup.stepI[2] * v2.z) * setup.inverseArea;
+    double dzdy = (setup.stepJ[0] * v0.z + setup.stepJ[1] * v1.z + setup.stepJ[2] * v2.z) * setup.inverseArea;
+
+    double rowEdge[3] = {setup.edge[0], setup.edge[1], setup.edge[2]};
+
+    for (int i = setup.iStart; i < setup.iEnd; i++)
+    {
+        double e0 = rowEdge[0], e1 = rowEdge[1], e2 = rowEdge[2];
+
+        for (int j = setup.jStart; j < setup.jEnd; j++, e0 += setup.stepJ[0], e1 += setup.stepJ[1], e2 += setup.stepJ[2])
+        {
+            unsigned mask = 0;
+            int first = -1;
+            for (int s = 0; s < multisampleCount; s++)
+            {
+                if (e0 + offset[0][s] >= 0 && e1 + offset[1][s] >= 0 && e2 + offset[2][s] >= 0)
+                {
+                    mask |= 1u << s;
+                    if (first < 0)
+                        first = s;
+                }
+            }
+            if (mask == 0)
+                continue;
+
+            double z = (e0 * v0.z + e1 * v1.z + e2 * v2.z) * setup.inverseArea;
+
+            if (depthOnly)
+            {
+                double *stored = &sampleDepths[((size_t)(i - drawXMin) * (drawYMax - drawYMin) + j - drawYMin) * multisampleCount];
+                for (int s = 0; s < multisampleCount; s++)
+                {
+                    double sampleZ = z + sampleX[s] * dzdx + sampleY[s] * dzdy;
+                    if ((mask & (1u << s)) && sampleZ < stored[s])
+                        stored[s] = sampleZ;
+                }
+                if (occlusionCullingEnabled)
+                    keepFarthestSample(i, j);
+                raster.fragmentsPrepassed++;
+                continue;
+            }
+
+            double s0 = e0, s1 = e1, s2 = e2;
+            if (s0 < 0 || s1 < 0 || s2 < 0)
+            {
+                s0 += offset[0][first];
+                s1 += offset[1][first];
+                s2 += offset[2][first];
+            }
+
+            double alpha = s0 * setup.inverseArea;
+            double beta = s1 * setup.inverseArea;
+            double gamma = s2 * setup.inverseArea;
+
+            if (perspectiveCorrectEnabled)
+            {
+                alpha *= v0.t;
+                beta *= v1.t;
+                gamma *= v2.t;
+
+                double normalization = 1 / (alpha + beta + gamma);
+                alpha *= normalization;
+                beta *= normalization;
+                gamma *= normalization;
+            }
+
+            Color color = (c0 * alpha) + (c1 * beta) + (c2 * gamma);
+            writeSamples(raster, i, j, mask, color, z, dzdx, dzdy);
+        }
+
+        rowEdge[0] += setup.stepI[0];
+        rowEdge[1] += setup.stepI[1];
+        rowEdge[2] += setup.stepI[2];
     }
 }
 
 void Scene::forwardRenderingPipeline(Camera *camera)
 {
-	// TODO: Implement this function.
+	// nothing rasterizes this projection again, so triangles are projected while they are drawn
+	prepareProjection(camera);
+	rasterizeGeometry(camera);
+}
+
+/*
+	Projection times camera transformation of the camera
+*/
+Matrix4 Scene::getViewingTransform(Camera *camera)
+{
 	Matrix4 Mfinal = Matrix4();
-	Matrix4 Mviewp = getViewportMatrix(camera);
 	Matrix4 Mcam = getCameraTransformation(camera);
 	if(camera->projectionType == 0){ //Orthographic
 		Matrix4 Morth = getOrtographicProjection(camera);
@@ -459,187 +948,1162 @@ void Scene::forwardRenderingPipeline(Camera *camera)
 		Matrix4 Mpers = getPerspectiveProjection(camera);
 		Mfinal = multiplyMatrixWithMatrix(Mpers, Mcam);
 	}
-	for(auto &mesh: this->meshes){
-		Matrix4 Mtransform = multiplyMatrixWithMatrix(Mfinal, getModelingTransform(*mesh));
-		for(auto &triangle: mesh->triangles){
-			Vec3* v1 =this->vertices[triangle.getFirstVertexId()-1];
-			Vec3* v2 =this->vertices[triangle.getSecondVertexId()-1];
-			Vec3* v3 =this->vertices[triangle.getThirdVertexId()-1];
+	return Mfinal;
+}
 
-			Vec4 vertex1 = multiplyMatrixWithVec4(Mtransform, Vec4(v1->x, v1->y, v1->z, 1, v1->colorId));
-			Vec4 vertex2 = multiplyMatrixWithVec4(Mtransform, Vec4(v2->x, v2->y, v2->z, 1, v2->colorId));
-			Vec4 vertex3 = multiplyMatrixWithVec4(Mtransform, Vec4(v3->x, v3->y, v3->z, 1, v3->colorId));
+// triangles of the level of detail drawn for mesh, -1 for full detail
+static vector<Triangle> &levelTriangles(Mesh *mesh, int level)
+{
+	return level < 0 ? mesh->geometry->triangles : mesh->geometry->lodLevels[level];
+}
 
-			//Dont compute back-facing polygons
-			if(cullingEnabled == 1 && !backFaceCulling(vertex1, vertex2, vertex3))
-				continue;
+/*
+	What both halves of the pipeline need before any triangle is projected:
+	each mesh's model to clip space transformation, projected bounds and
+	level of detail for camera, and the draw order. Triangles are not kept,
+	rasterizeGeometry projects each mesh while drawing it.
+	With level of detail enabled, each mesh contributes the triangles of the
+	level selectLevelOfDetail picks for camera.
+*/
+void Scene::prepareProjection(Camera *camera)
+{
+	Matrix4 Mfinal = getViewingTransform(camera);
+	Matrix4 Mviewp = getViewportMatrix(camera);
 
-			//Perspective division
+	projectionKept = false;
+	projectedMeshes.clear();
+	projectedTransforms.resize(meshes.size());
+	projectedLevels.resize(meshes.size());
+	projectedBounds.resize(meshes.size());
+	stats.reset();
 
-			perspectiveDivision(vertex1);
-			perspectiveDivision(vertex2);
-			perspectiveDivision(vertex3);
+	for(int m = 0; m < meshes.size(); m++){
+		Mesh *mesh = meshes[m];
+		projectedBounds[m].valid = false;
+		projectedLevels[m] = -1;
 
-			//Viewport Transformation
-			vertex1 = multiplyMatrixWithVec4(Mviewp, vertex1);
-			vertex2 = multiplyMatrixWithVec4(Mviewp, vertex2);
-			vertex3 = multiplyMatrixWithVec4(Mviewp, vertex3);
+		// instances share the triangles of their geometry mesh but not its transformations
+		projectedTransforms[m] = multiplyMatrixWithMatrix(Mfinal, getModelingTransform(*mesh));
 
-			//wireframe
-			if(!mesh->type){
+		if(!mesh->geometry->streamFile.empty())
+			continue;
 
-				//Creating temp variables to pass unmodified versions of vertices to lineRasterizer.
-				Vec4 v1 = Vec4(vertex1); Vec4 v11 = Vec4(vertex1);
-				Vec4 v2 = Vec4(vertex2); Vec4 v22 = Vec4(vertex2);
-				Vec4 v3 = Vec4(vertex3); Vec4 v33 = Vec4(vertex3);
+		projectBounds(mesh, projectedTransforms[m], projectedBounds[m]);
+		if(lodEnabled)
+			projectedLevels[m] = selectLevelOfDetail(mesh, projectedBounds[m], Mviewp);
 
-				if(clipping(v1,v2,camera->horRes, camera->verRes)){
-					lineRasterizer(v1,v2);
-				}
-					
-				if(clipping(v22,v3,camera->horRes, camera->verRes)){
-					lineRasterizer(v22,v3);
-				}
-					
-				if(clipping(v33,v11,camera->horRes, camera->verRes)){
-					lineRasterizer(v33,v11);
-				}
-					
-			} 
-			//solid
-			else{
-				triangleRasterizer(vertex1, vertex2, vertex3, camera->horRes, camera->verRes);
-			}
-		}
+		stats.trianglesIn += mesh->geometry->triangles.size();
+		stats.lodTrianglesSaved += mesh->geometry->triangles.size() - levelTriangles(mesh, projectedLevels[m]).size();
 	}
-}
 
-double Scene::lineEquation(double xp, double yp, double x1, double y1, double x2, double y2){
-    return xp * (y1 - y2) + yp * (x2 - x1) + (x1 * y2) - (y1 * x2);
+	orderMeshes();
 }
 
 /*
-	Parses XML file
+	Perspective divided triangles of mesh m, 3 vertices each, into projected.
+	Triangles facing away at the resolution of Mviewp are culled. The
+	triangles culled and kept are added to counts.
 */
-Scene::Scene(const char *xmlPath)
+void Scene::projectMesh(int m, Matrix4 &Mviewp, vector<Vec4> &projected, RenderStats &counts)
 {
-	const char *str;
-	XMLDocument xmlDoc;
-	XMLElement *pElement;
+	Mesh *mesh = meshes[m];
+	Matrix4 &Mtransform = projectedTransforms[m];
+	vector<Triangle> &triangles = levelTriangles(mesh, projectedLevels[m]);
 
-	xmlDoc.LoadFile(xmlPath);
+	projected.clear();
+	if(!mesh->geometry->streamFile.empty())
+		return;
 
-	XMLNode *pRoot = xmlDoc.FirstChild();
+	projected.reserve(3 * triangles.size());
 
-	// read background color
-	pElement = pRoot->FirstChildElement("BackgroundColor");
-	str = pElement->GetText();
-	sscanf(str, "%lf %lf %lf", &backgroundColor.r, &backgroundColor.g, &backgroundColor.b);
+	for(auto &triangle: triangles){
+		Vec3* v1 =this->vertices[triangle.getFirstVertexId()-1];
+		Vec3* v2 =this->vertices[triangle.getSecondVertexId()-1];
+		Vec3* v3 =this->vertices[triangle.getThirdVertexId()-1];
 
-	// read culling
-	pElement = pRoot->FirstChildElement("Culling");
-	if (pElement != NULL) {
-		str = pElement->GetText();
-		
-		if (strcmp(str, "enabled") == 0) {
-			cullingEnabled = true;
-		}
-		else {
-			cullingEnabled = false;
-		}
-	}
+		Vec4 vertex1 = multiplyMatrixWithVec4(Mtransform, Vec4(v1->x, v1->y, v1->z, 1, v1->colorId));
+		Vec4 vertex2 = multiplyMatrixWithVec4(Mtransform, Vec4(v2->x, v2->y, v2->z, 1, v2->colorId));
+		Vec4 vertex3 = multiplyMatrixWithVec4(Mtransform, Vec4(v3->x, v3->y, v3->z, 1, v3->colorId));
 
-	// read cameras
-	pElement = pRoot->FirstChildElement("Cameras");
-	XMLElement *pCamera = pElement->FirstChildElement("Camera");
-	XMLElement *camElement;
-	while (pCamera != NULL)
-	{
-		Camera *cam = new Camera();
+		//Perspective division
 
-		pCamera->QueryIntAttribute("id", &cam->cameraId);
+		divideKeepingInverseW(vertex1);
+		divideKeepingInverseW(vertex2);
+		divideKeepingInverseW(vertex3);
 
-		// read projection type
-		str = pCamera->Attribute("type");
+		//Dont keep back-facing or degenerate polygons
+		if(cullingEnabled){
+			Vec4 screen1 = viewportTransform(Mviewp, vertex1);
+			Vec4 screen2 = viewportTransform(Mviewp, vertex2);
+			Vec4 screen3 = viewportTransform(Mviewp, vertex3);
 
-		if (strcmp(str, "orthographic") == 0) {
-			cam->projectionType = 0;
-		}
-		else {
-			cam->projectionType = 1;
+			if(signedArea(screen1, screen2, screen3) * frontFaceWinding <= 0){
+				counts.trianglesCulled++;
+				continue;
+			}
 		}
 
-		camElement = pCamera->FirstChildElement("Position");
-		str = camElement->GetText();
-		sscanf(str, "%lf %lf %lf", &cam->pos.x, &cam->pos.y, &cam->pos.z);
+		projected.push_back(vertex1);
+		projected.push_back(vertex2);
+		projected.push_back(vertex3);
+	}
 
-		camElement = pCamera->FirstChildElement("Gaze");
-		str = camElement->GetText();
-		sscanf(str, "%lf %lf %lf", &cam->gaze.x, &cam->gaze.y, &cam->gaze.z);
+	counts.trianglesProjected += projected.size() / 3;
+}
 
-		camElement = pCamera->FirstChildElement("Up");
-		str = camElement->GetText();
-		sscanf(str, "%lf %lf %lf", &cam->v.x, &cam->v.y, &cam->v.z);
+/*
+	First half of the pipeline: modeling, viewing and perspective division,
+	then culling at the camera's resolution. The surviving triangles of each
+	mesh are kept in projectedMeshes (3 vertices each, after perspective
+	division), so rasterizeGeometry can draw them again at other resolutions
+	or under other scissors without redoing this work.
+	Streamed meshes are not kept, rasterizeGeometry reads them again.
+*/
+void Scene::projectGeometry(Camera *camera)
+{
+	Matrix4 Mviewp = getViewportMatrix(camera);
 
-		cam->gaze = normalizeVec3(cam->gaze);
-		cam->u = crossProductVec3(cam->gaze, cam->v);
-		cam->u = normalizeVec3(cam->u);
+	prepareProjection(camera);
+	projectionKept = true;
+	projectedMeshes.resize(meshes.size());
 
-		cam->w = inverseVec3(cam->gaze);
-		cam->v = crossProductVec3(cam->u, cam->gaze);
-		cam->v = normalizeVec3(cam->v);
+	// meshes are projected in parallel, each counting into its own stats
+	vector<RenderStats> meshStats(meshes.size());
 
-		camElement = pCamera->FirstChildElement("ImagePlane");
-		str = camElement->GetText();
-		sscanf(str, "%lf %lf %lf %lf %lf %lf %d %d",
-			   &cam->left, &cam->right, &cam->bottom, &cam->top,
-			   &cam->near, &cam->far, &cam->horRes, &cam->verRes);
+	taskScheduler().run(meshes.size(), [&](int m, int threadIndex) {
+		projectMesh(m, Mviewp, projectedMeshes[m], meshStats[m]);
+	}, stats.threadBusyMs, stats.threadIdleMs);
 
-		camElement = pCamera->FirstChildElement("OutputName");
-		str = camElement->GetText();
-		cam->outputFileName = string(str);
+	for(int m = 0; m < meshes.size(); m++){
+		stats.trianglesCulled += meshStats[m].trianglesCulled;
+		stats.trianglesProjected += meshStats[m].trianglesProjected;
+	}
+}
 
-		cameras.push_back(cam);
+/*
+	Sets drawOrder to the meshes in input order or, with front to back
+	sorting, puts the solid meshes nearest first into the places solid
+	meshes have in the input. Wireframe meshes keep their places. Meshes
+	without projected bounds count as farthest.
+*/
+void Scene::orderMeshes()
+{
+	drawOrder.resize(meshes.size());
+	for(int m = 0; m < meshes.size(); m++)
+		drawOrder[m] = m;
 
-		pCamera = pCamera->NextSiblingElement("Camera");
-	}
+	if(!frontToBackEnabled)
+		return;
 
-	// read vertices
-	pElement = pRoot->FirstChildElement("Vertices");
-	XMLElement *pVertex = pElement->FirstChildElement("Vertex");
-	int vertexId = 1;
+	vector<int> solids;
+	for(int m = 0; m < meshes.size(); m++){
+		if(meshes[m]->type)
+			solids.push_back(m);
+	}
 
-	while (pVertex != NULL)
-	{
-		Vec3 *vertex = new Vec3();
-		Color *color = new Color();
+	vector<double> nearest(meshes.size());
+	for(int m = 0; m < meshes.size(); m++)
+		nearest[m] = projectedBounds[m].valid ? projectedBounds[m].zMin : numeric_limits<double>::infinity();
 
-		vertex->colorId = vertexId;
+	vector<int> sorted = solids;
+	stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return nearest[a] < nearest[b]; });
 
-		str = pVertex->Attribute("position");
-		sscanf(str, "%lf %lf %lf", &vertex->x, &vertex->y, &vertex->z);
+	for(int i = 0; i < solids.size(); i++)
+		drawOrder[solids[i]] = sorted[i];
+}
 
-		str = pVertex->Attribute("color");
-		sscanf(str, "%lf %lf %lf", &color->r, &color->g, &color->b);
+/*
+	Box around the bounds of mesh's geometry after perspective division, with
+	Mtransform taking model space to clip space. False when the geometry has
+	no bounds or a corner lies behind the eye, where the box cannot be trusted.
+*/
+bool Scene::projectBounds(Mesh *mesh, Matrix4 &Mtransform, MeshScreenBounds &bounds)
+{
+	Mesh *geometry = mesh->geometry;
+	bounds.valid = false;
+	if(!geometry->hasBounds)
+		return false;
 
-		vertices.push_back(vertex);
-		colorsOfVertices.push_back(color);
+	for(int c = 0; c < 8; c++){
+		Vec4 corner = multiplyMatrixWithVec4(Mtransform, Vec4(c & 1 ? geometry->boundsMax.x : geometry->boundsMin.x,
+		                                                      c & 2 ? geometry->boundsMax.y : geometry->boundsMin.y,
+		                                                      c & 4 ? geometry->boundsMax.z : geometry->boundsMin.z, 1, 0));
+		if(corner.t <= EPSILON)
+			return false;
 
-		pVertex = pVertex->NextSiblingElement("Vertex");
+		perspectiveDivision(corner);
 
-		vertexId++;
+		if(c == 0){
+			bounds.xMin = bounds.xMax = corner.x;
+			bounds.yMin = bounds.yMax = corner.y;
+			bounds.zMin = corner.z;
+		}
+		bounds.xMin = min(bounds.xMin, corner.x);
+		bounds.xMax = max(bounds.xMax, corner.x);
+		bounds.yMin = min(bounds.yMin, corner.y);
+		bounds.yMax = max(bounds.yMax, corner.y);
+		bounds.zMin = min(bounds.zMin, corner.z);
 	}
 
-	// read translations
-	pElement = pRoot->FirstChildElement("Translations");
-	XMLElement *pTranslation = pElement->FirstChildElement("Translation");
-	while (pTranslation != NULL)
-	{
-		Translation *translation = new Translation();
+	bounds.valid = true;
+	return true;
+}
+
+// bounds given after perspective division taken to the screen by Mviewp
+static MeshScreenBounds viewportBounds(const MeshScreenBounds &bounds, Matrix4 &Mviewp)
+{
+	Vec4 low = multiplyMatrixWithVec4(Mviewp, Vec4(bounds.xMin, bounds.yMin, bounds.zMin, 1, 0));
+	Vec4 high = multiplyMatrixWithVec4(Mviewp, Vec4(bounds.xMax, bounds.yMax, bounds.zMin, 1, 0));
+
+	MeshScreenBounds screen;
+	screen.valid = bounds.valid;
+	screen.xMin = low.x;
+	screen.yMin = low.y;
+	screen.xMax = high.x;
+	screen.yMax = high.y;
+	screen.zMin = low.z;
+	return screen;
+}
+
+/*
+	Picks the coarsest level of detail of mesh whose error, scaled from model
+	units to pixels by how large its projected bounds appear on screen, is at
+	most lodThreshold. -1 stands for the full triangles.
+*/
+int Scene::selectLevelOfDetail(Mesh *mesh, MeshScreenBounds &bounds, Matrix4 &Mviewp)
+{
+	Mesh *geometry = mesh->geometry;
+
+	if(geometry->lodLevels.empty() || !bounds.valid)
+		return -1;
+
+	MeshScreenBounds screen = viewportBounds(bounds, Mviewp);
+	double width = screen.xMax - screen.xMin, height = screen.yMax - screen.yMin;
+
+	double diagonal = magnitudeOfVec3(subtractVec3(geometry->boundsMax, geometry->boundsMin));
+	if(diagonal < EPSILON)
+		return -1;
+
+	double pixelsPerUnit = sqrt(width * width + height * height) / diagonal;
+
+	int level = -1;
+	while(level + 1 < geometry->lodLevels.size() && geometry->lodErrors[level + 1] * pixelsPerUnit <= lodThreshold)
+		level++;
+	return level;
+}
+
+/*
+	Builds levelCount levels of detail for every mesh holding its own
+	triangles, each level about ratio times the size of the one before, and
+	enables their use. Meshes are simplified in parallel.
+*/
+void Scene::buildLevelsOfDetail(int levelCount, double ratio)
+{
+	vector<Mesh *> sources;
+	for(int i = 0; i < meshes.size(); i++){
+		if(meshes[i]->geometry == meshes[i] && !meshes[i]->triangles.empty())
+			sources.push_back(meshes[i]);
+	}
+
+	int threadCount = min((int)thread::hardware_concurrency(), (int)sources.size());
+	atomic<int> nextMesh(0);
+
+	auto simplifyMeshes = [&]() {
+		for(int i = nextMesh++; i < sources.size(); i = nextMesh++)
+			::buildLevelsOfDetail(vertices, sources[i]->triangles, levelCount, ratio, sources[i]->lodLevels, sources[i]->lodErrors);
+	};
+
+	vector<thread> simplifiers;
+	for(int i = 1; i < threadCount; i++)
+		simplifiers.push_back(thread(simplifyMeshes));
+	simplifyMeshes();
+	for(int i = 0; i < simplifiers.size(); i++)
+		simplifiers[i].join();
+
+	lodEnabled = true;
+}
+
+/*
+	Screen rectangle [xMin, xMax) x [yMin, yMax) that mesh m may touch, with
+	the margin rasterizeTriangle keeps for lines, or the whole draw area when
+	its bounds are not known. Returns true when occlusion culling is on and
+	the depth pyramid shows all of it drawn nearer than the mesh's bounds.
+*/
+bool Scene::meshOccluded(int m, Matrix4 &Mviewp, int &xMin, int &yMin, int &xMax, int &yMax)
+{
+	xMin = drawXMin; yMin = drawYMin; xMax = drawXMax; yMax = drawYMax;
+
+	if(!occlusionCullingEnabled || !projectedBounds[m].valid)
+		return false;
+
+	MeshScreenBounds screen = viewportBounds(projectedBounds[m], Mviewp);
+	xMin = max(xMin, (int)floor(screen.xMin) - 2);
+	yMin = max(yMin, (int)floor(screen.yMin) - 2);
+	xMax = min(xMax, (int)floor(screen.xMax) + 3);
+	yMax = min(yMax, (int)floor(screen.yMax) + 3);
+
+	if(!depthPyramid.occluded(xMin - drawXMin, yMin - drawYMin, xMax - drawXMin, yMax - drawYMin, screen.zMin))
+		return false;
+
+	stats.meshesOccluded++;
+	stats.trianglesOccluded += projectionKept ? projectedMeshes[m].size() / 3 : levelTriangles(meshes[m], projectedLevels[m]).size();
+	return true;
+}
+
+/*
+	Second half of the pipeline: viewport transformation at the resolution of
+	camera and rasterization of what projectGeometry kept. camera may be a
+	copy of the projected camera with a different resolution. After
+	prepareProjection, camera must be the prepared one and each mesh is
+	projected just before it is drawn, counting culled and projected
+	triangles; occluded meshes are then not projected at all.
+	Meshes are drawn in drawOrder. With occlusion culling, a mesh is skipped
+	when the depth pyramid shows everything under its screen bounds already
+	drawn nearer than the bounds.
+	With the depth prepass, the depth of all solid meshes is rasterized
+	first without colors. The shading pass then colors only the fragment
+	whose depth the prepass kept, so every visible pixel of them is shaded
+	once. Lines and streamed meshes are drawn with the ordinary depth test
+	in the shading pass.
+*/
+void Scene::rasterizeGeometry(Camera *camera)
+{
+	Matrix4 Mviewp = getViewportMatrix(camera);
+	meshPixelWrites.assign(meshes.size(), 0);
+	stats.meshesOccluded = 0;
+	stats.trianglesOccluded = 0;
+	stats.fragmentsShaded = 0;
+	stats.fragmentsPrepassed = 0;
+
+	// occlusion culling reads depth across tiles in draw order
+	if(taskScheduler().threadCount() > 1 && !occlusionCullingEnabled)
+		rasterizeTiles(camera, Mviewp);
+	else
+		rasterizeMeshes(camera, Mviewp);
+
+	if(multisampleCount > 1)
+		resolveSamples();
+	else if(tiledFramebufferEnabled)
+		tiledImage.detile(image);
+}
+
+// rasterizeGeometry on the calling thread, mesh by mesh
+void Scene::rasterizeMeshes(Camera *camera, Matrix4 &Mviewp)
+{
+	RasterContext &raster = rasterContexts[0];
+	raster.begin(drawXMin, drawYMin, drawXMax, drawYMax);
+
+	vector<bool> occluded(meshes.size(), false);
+	int xMin, yMin, xMax, yMax;
+
+	// without a kept projection one mesh at a time is projected into buffer
+	vector<Vec4> buffer;
+	RenderStats uncounted;
+	auto trianglesOf = [&](int m, RenderStats &counts) -> vector<Vec4> & {
+		if(projectionKept)
+			return projectedMeshes[m];
+		projectMesh(m, Mviewp, buffer, counts);
+		return buffer;
+	};
+
+	if(depthPrepassEnabled){
+		// occlusion is decided here, against the depth of the meshes before
+		for(int k = 0; k < drawOrder.size(); k++){
+			int m = drawOrder[k];
+			occluded[m] = meshOccluded(m, Mviewp, xMin, yMin, xMax, yMax);
+			if(occluded[m] || !meshes[m]->type)
+				continue;
+
+			// counted when the shading pass projects the mesh again
+			vector<Vec4> &projected = trianglesOf(m, uncounted);
+			for(int i = 0; i < projected.size(); i += 3){
+				Vec4 vertex1 = viewportTransform(Mviewp, projected[i]);
+				Vec4 vertex2 = viewportTransform(Mviewp, projected[i + 1]);
+				Vec4 vertex3 = viewportTransform(Mviewp, projected[i + 2]);
+
+				triangleDepthRasterizer(raster, vertex1, vertex2, vertex3, camera->horRes, camera->verRes);
+			}
+
+			if(occlusionCullingEnabled)
+				depthPyramid.update(depth, xMin - drawXMin, yMin - drawYMin, xMax - drawXMin, yMax - drawYMin);
+		}
+	}
+
+	for(int k = 0; k < drawOrder.size(); k++){
+		int m = drawOrder[k];
+		Mesh *mesh = meshes[m];
+		long writesBefore = raster.pixelWrites;
+
+		if(depthPrepassEnabled ? occluded[m] : meshOccluded(m, Mviewp, xMin, yMin, xMax, yMax))
+			continue;
+
+		vector<Vec4> &projected = trianglesOf(m, stats);
+
+		if(!mesh->geometry->streamFile.empty()){
+			streamMesh(mesh, projectedTransforms[m], Mviewp, [&](vector<Vec4> &chunk, vector<Color> &colors) {
+				raster.streamColors = colors.data();
+				for(int i = 0; i < chunk.size(); i += 3)
+					rasterizeTriangle(raster, mesh->type, chunk[i], chunk[i + 1], chunk[i + 2], camera);
+				raster.streamColors = NULL;
+			});
+		}
+
+		raster.shadingPass = depthPrepassEnabled && mesh->type;
+
+		for(int i = 0; i < projected.size(); i += 3){
+			//Viewport Transformation
+			Vec4 vertex1 = viewportTransform(Mviewp, projected[i]);
+			Vec4 vertex2 = viewportTransform(Mviewp, projected[i + 1]);
+			Vec4 vertex3 = viewportTransform(Mviewp, projected[i + 2]);
+
+			rasterizeTriangle(raster, mesh->type, vertex1, vertex2, vertex3, camera);
+		}
+
+		raster.shadingPass = false;
+
+		if(occlusionCullingEnabled && !depthPrepassEnabled)
+			depthPyramid.update(depth, xMin - drawXMin, yMin - drawYMin, xMax - drawXMin, yMax - drawYMin);
+
+		meshPixelWrites[m] = raster.pixelWrites - writesBefore;
+	}
+
+	stats.fragmentsShaded += raster.fragmentsShaded;
+	stats.fragmentsPrepassed += raster.fragmentsPrepassed;
+	pixelWrites += raster.pixelWrites;
+}
+
+// a triangle in a tile's bin, vertices points at its first screen space vertex
+class BinnedTriangle
+{
+public:
+	int mesh;
+	Vec4 *vertices;
+};
+
+static const int rasterTileSize = 64;
+
+/*
+	rasterizeGeometry in screen tiles on the task scheduler. The viewport
+	transformation, after the projection when it was not kept, runs as one
+	task per mesh. Then every triangle is binned, in draw order, to the
+	tiles its bounds touch (with the margin rasterizeTriangle keeps for the
+	midpoint walk). Each tile task draws its
+	bin clipped to the tile, depth prepass first. The kernels cover the same
+	pixels whatever they are clipped to, so the image is the one drawn at once.
+	A streamed mesh is read once on the calling thread: what is binned before
+	it is drawn first, then each of its chunks is binned and drawn by itself.
+*/
+void Scene::rasterizeTiles(Camera *camera, Matrix4 &Mviewp)
+{
+	TaskScheduler &scheduler = taskScheduler();
+	vector< vector<Vec4> > screen(meshes.size());
+	vector<RenderStats> meshStats(projectionKept ? 0 : meshes.size());
+
+	scheduler.run(drawOrder.size(), [&](int k, int threadIndex) {
+		int m = drawOrder[k];
+
+		if(projectionKept){
+			vector<Vec4> &projected = projectedMeshes[m];
+			screen[m].resize(projected.size());
+			for(int i = 0; i < projected.size(); i++)
+				screen[m][i] = viewportTransform(Mviewp, projected[i]);
+		}
+		else{
+			projectMesh(m, Mviewp, screen[m], meshStats[m]);
+			for(int i = 0; i < screen[m].size(); i++)
+				screen[m][i] = viewportTransform(Mviewp, screen[m][i]);
+		}
+	}, stats.threadBusyMs, stats.threadIdleMs);
+
+	for(int m = 0; m < meshStats.size(); m++){
+		stats.trianglesCulled += meshStats[m].trianglesCulled;
+		stats.trianglesProjected += meshStats[m].trianglesProjected;
+	}
+
+	int tilesX = (drawXMax - drawXMin + rasterTileSize - 1) / rasterTileSize;
+	int tilesY = (drawYMax - drawYMin + rasterTileSize - 1) / rasterTileSize;
+	vector< vector<BinnedTriangle> > bins(tilesX * tilesY);
+	bool binned = false;
+
+	auto bin = [&](int m, vector<Vec4> &vertices) {
+		for(int i = 0; i < vertices.size(); i += 3){
+			Vec4 &v1 = vertices[i], &v2 = vertices[i + 1], &v3 = vertices[i + 2];
+			double xMin = min({v1.x, v2.x, v3.x}) - 2 - drawXMin, xMax = max({v1.x, v2.x, v3.x}) + 2 - drawXMin;
+			double yMin = min({v1.y, v2.y, v3.y}) - 2 - drawYMin, yMax = max({v1.y, v2.y, v3.y}) + 2 - drawYMin;
+
+			// written this way round so that NaN bounds are dropped too
+			if(!(xMax >= 0 && yMax >= 0 && xMin <= drawXMax - drawXMin && yMin <= drawYMax - drawYMin))
+				continue;
+
+			int tileXMin = (int)max(0.0, floor(xMin / rasterTileSize)), tileXMax = (int)min(tilesX - 1.0, floor(xMax / rasterTileSize));
+			int tileYMin = (int)max(0.0, floor(yMin / rasterTileSize)), tileYMax = (int)min(tilesY - 1.0, floor(yMax / rasterTileSize));
+
+			BinnedTriangle triangle;
+			triangle.mesh = m;
+			triangle.vertices = &vertices[i];
+			for(int ty = tileYMin; ty <= tileYMax; ty++){
+				for(int tx = tileXMin; tx <= tileXMax; tx++)
+					bins[ty * tilesX + tx].push_back(triangle);
+			}
+			binned = true;
+		}
+	};
+
+	// counters per thread, summed once all tiles are drawn
+	vector<RasterContext> counted(scheduler.threadCount());
+	vector< vector<long> > meshWrites(overdrawEnabled ? scheduler.threadCount() : 0, vector<long>(meshes.size(), 0));
+
+	// draws and empties the bins, streamColors is set while a streamed chunk is drawn
+	auto drawBins = [&](bool prepass, bool shade, const Color *streamColors) {
+		if(!binned)
+			return;
+
+		scheduler.run(bins.size(), [&](int tile, int threadIndex) {
+			RasterContext &raster = rasterContexts[threadIndex];
+			int xMin = drawXMin + tile % tilesX * rasterTileSize;
+			int yMin = drawYMin + tile / tilesX * rasterTileSize;
+			raster.begin(xMin, yMin, min(xMin + rasterTileSize, drawXMax), min(yMin + rasterTileSize, drawYMax));
+			raster.streamColors = streamColors;
+
+			vector<BinnedTriangle> &bin = bins[tile];
+
+			if(prepass){
+				for(int b = 0; b < bin.size(); b++){
+					if(!meshes[bin[b].mesh]->type)
+						continue;
+
+					Vec4 vertex1(bin[b].vertices[0]), vertex2(bin[b].vertices[1]), vertex3(bin[b].vertices[2]);
+					triangleDepthRasterizer(raster, vertex1, vertex2, vertex3, camera->horRes, camera->verRes);
+				}
+			}
+
+			for(int b = 0; shade && b < bin.size(); b++){
+				int type = meshes[bin[b].mesh]->type;
+				long writesBefore = raster.pixelWrites;
+
+				Vec4 vertex1(bin[b].vertices[0]), vertex2(bin[b].vertices[1]), vertex3(bin[b].vertices[2]);
+
+				// streamed triangles take no part in the prepass and are depth tested as usual
+				raster.shadingPass = depthPrepassEnabled && type && streamColors == NULL;
+				rasterizeTriangle(raster, type, vertex1, vertex2, vertex3, camera);
+
+				if(overdrawEnabled)
+					meshWrites[threadIndex][bin[b].mesh] += raster.pixelWrites - writesBefore;
+			}
+
+			counted[threadIndex].fragmentsShaded += raster.fragmentsShaded;
+			counted[threadIndex].fragmentsPrepassed += raster.fragmentsPrepassed;
+			counted[threadIndex].pixelWrites += raster.pixelWrites;
+			bin.clear();
+		}, stats.threadBusyMs, stats.threadIdleMs);
+
+		binned = false;
+	};
+
+	bool streaming = false;
+	for(int m = 0; m < meshes.size(); m++){
+		if(!meshes[m]->geometry->streamFile.empty())
+			streaming = true;
+	}
+
+	// the depth prepass covers every other mesh before anything is shaded, with streamed meshes as a batch of its own
+	if(depthPrepassEnabled && streaming){
+		for(int k = 0; k < drawOrder.size(); k++)
+			bin(drawOrder[k], screen[drawOrder[k]]);
+		drawBins(true, false, NULL);
+	}
+
+	for(int k = 0; k < drawOrder.size(); k++){
+		int m = drawOrder[k];
+		Mesh *mesh = meshes[m];
+
+		if(mesh->geometry->streamFile.empty()){
+			bin(m, screen[m]);
+			continue;
+		}
+
+		drawBins(false, true, NULL);
+
+		streamMesh(mesh, projectedTransforms[m], Mviewp, [&](vector<Vec4> &chunk, vector<Color> &colors) {
+			bin(m, chunk);
+			drawBins(false, true, colors.data());
+		});
+	}
+
+	drawBins(depthPrepassEnabled && !streaming, true, NULL);
+
+	for(int t = 0; t < counted.size(); t++){
+		stats.fragmentsShaded += counted[t].fragmentsShaded;
+		stats.fragmentsPrepassed += counted[t].fragmentsPrepassed;
+		pixelWrites += counted[t].pixelWrites;
+	}
+	for(int t = 0; t < meshWrites.size(); t++){
+		for(int m = 0; m < meshes.size(); m++)
+			meshPixelWrites[m] += meshWrites[t][m];
+	}
+}
+
+/*
+	Clips and rasterizes a triangle given in screen space
+*/
+void Scene::rasterizeTriangle(RasterContext &raster, int type, Vec4 &vertex1, Vec4 &vertex2, Vec4 &vertex3, Camera *camera)
+{
+	//Skip clipping and rasterization of triangles away from the scissor, with
+	//a margin for the midpoint walk stepping past line ends
+	if(max({vertex1.x, vertex2.x, vertex3.x}) < raster.clipXMin - 2 || min({vertex1.x, vertex2.x, vertex3.x}) > raster.clipXMax + 2 ||
+	   max({vertex1.y, vertex2.y, vertex3.y}) < raster.clipYMin - 2 || min({vertex1.y, vertex2.y, vertex3.y}) > raster.clipYMax + 2)
+		return;
+
+	//wireframe
+	if(!type){
+
+		//Creating temp variables to pass unmodified versions of vertices to lineRasterizer.
+		Vec4 v1 = Vec4(vertex1); Vec4 v11 = Vec4(vertex1);
+		Vec4 v2 = Vec4(vertex2); Vec4 v22 = Vec4(vertex2);
+		Vec4 v3 = Vec4(vertex3); Vec4 v33 = Vec4(vertex3);
+
+		if(clipping(raster, v1,v2,camera->horRes, camera->verRes)){
+			lineRasterizer(raster, v1,v2);
+		}
+			
+		if(clipping(raster, v22,v3,camera->horRes, camera->verRes)){
+			lineRasterizer(raster, v22,v3);
+		}
+			
+		if(clipping(raster, v33,v11,camera->horRes, camera->verRes)){
+			lineRasterizer(raster, v33,v11);
+		}
+			
+	} 
+	//solid
+	else{
+		triangleRasterizer(raster, vertex1, vertex2, vertex3, camera->horRes, camera->verRes);
+	}
+}
+
+/*
+	Out-of-core rendering: reads the mesh's STL file streamChunkSize triangles
+	at a time and hands each chunk to drawChunk in screen space, with back
+	faces culled, before the next read. The corners of a chunk carry color
+	ids past the scene's colors that index the chunk's colors (see
+	vertexColor), so memory stays bounded by the chunk size and the scene's
+	colors are never touched.
+*/
+void Scene::streamMesh(Mesh *mesh, Matrix4 &Mtransform, Matrix4 &Mviewp, const function<void(vector<Vec4> &, vector<Color> &)> &drawChunk)
+{
+	Mesh *geometry = mesh->geometry;
+	STLReader reader;
+	if (!reader.open(geometry->streamFile)) {
+		return;
+	}
+
+	vector<Vec3> corners;
+	vector<Color> colors;
+	vector<Vec4> chunk;
+	int colorBase = colorsOfVertices.size();
+
+	while (reader.readChunk(streamChunkSize, geometry->streamColor, corners, colors) > 0)
+	{
+		chunk.clear();
+
+		for (int i = 0; i < colors.size(); i++) {
+			// flat colored facets, all three corners share the facet color
+			Vec4 vertex[3];
+			for (int j = 0; j < 3; j++) {
+				Vec3 &corner = corners[3 * i + j];
+				vertex[j] = multiplyMatrixWithVec4(Mtransform, Vec4(corner.x, corner.y, corner.z, 1, colorBase + i + 1));
+				divideKeepingInverseW(vertex[j]);
+				vertex[j] = viewportTransform(Mviewp, vertex[j]);
+			}
+
+			//Dont compute back-facing or degenerate polygons
+			if (cullingEnabled && signedArea(vertex[0], vertex[1], vertex[2]) * frontFaceWinding <= 0) {
+				continue;
+			}
+
+			chunk.insert(chunk.end(), vertex, vertex + 3);
+		}
+
+		drawChunk(chunk, colors);
+	}
+}
+
+double Scene::lineEquation(double xp, double yp, double x1, double y1, double x2, double y2){
+    return xp * (y1 - y2) + yp * (x2 - x1) + (x1 * y2) - (y1 * x2);
+}
+
+// "enabled" as the text of an optional switch element
+static bool enabledText(XMLElement *pElement)
+{
+	return pElement != NULL && pElement->GetText() != NULL && strcmp(pElement->GetText(), "enabled") == 0;
+}
+
+// text of a child element the scene cannot do without, NULL after printing what is missing
+static const char *requiredText(XMLElement *pParent, const char *name)
+{
+	XMLElement *pElement = pParent->FirstChildElement(name);
+	if (pElement == NULL || pElement->GetText() == NULL) {
+		cerr << "<" << pParent->Name() << "> has no <" << name << ">" << endl;
+		return NULL;
+	}
+	return pElement->GetText();
+}
+
+// value of an attribute the scene cannot do without, NULL after printing what is missing
+static const char *requiredAttribute(XMLElement *pElement, const char *name)
+{
+	const char *value = pElement->Attribute(name);
+	if (value == NULL) {
+		cerr << "<" << pElement->Name() << "> has no " << name << " attribute" << endl;
+	}
+	return value;
+}
+
+/*
+	Resolves a mesh file name against directory. A confined scene may only
+	name files below directory, so absolute names and ".." are refused.
+*/
+static bool meshFilePath(const char *name, const string &directory, bool confined, string &path)
+{
+	if (confined && (name[0] == '/' || ("/" + string(name) + "/").find("/../") != string::npos)) {
+		cerr << "mesh file " << name << " is outside the scene directory" << endl;
+		return false;
+	}
+
+	path = name[0] == '/' ? string(name) : directory + name;
+	return true;
+}
+
+/*
+	Parses a single <Mesh> element into mesh, false when it is malformed.
+	Only touches nodes below pMesh, so different meshes can be parsed concurrently.
+*/
+static bool parseMesh(XMLElement *pMesh, Mesh *mesh, const string &directory, bool confined, ImportedMesh *&imported)
+{
+	const char *str;
+
+	pMesh->QueryIntAttribute("id", &mesh->meshId);
+
+	// read projection type
+	str = pMesh->Attribute("type");
+
+	if (str != NULL && strcmp(str, "wireframe") == 0) {
+		mesh->type = 0;
+	}
+	else {
+		mesh->type = 1;
+	}
+
+	// read mesh transformations
+	XMLElement *pTransformations = pMesh->FirstChildElement("Transformations");
+	XMLElement *pTransformation = pTransformations != NULL ? pTransformations->FirstChildElement("Transformation") : NULL;
+
+	while (pTransformation != NULL)
+	{
+		char transformationType;
+		int transformationId;
+
+		str = pTransformation->GetText();
+		if (str == NULL || sscanf(str, "%c %d", &transformationType, &transformationId) != 2) {
+			cerr << "mesh " << mesh->meshId << " has an empty <Transformation>" << endl;
+			return false;
+		}
+
+		mesh->transformationTypes.push_back(transformationType);
+		mesh->transformationIds.push_back(transformationId);
+
+		pTransformation = pTransformation->NextSiblingElement("Transformation");
+	}
+
+	mesh->numberOfTransformations = mesh->transformationIds.size();
+
+	// read mesh faces, either inline or from an OBJ/PLY file relative to the XML,
+	// instances get the geometry of the mesh they name once all meshes are read
+	str = pMesh->Attribute("file");
+	if (pMesh->QueryIntAttribute("instanceOf", &mesh->instanceOf) == XML_SUCCESS) {
+		mesh->numberOfTriangles = 0;
+		return true;
+	}
+	else if (str != NULL) {
+		string path;
+		if (!meshFilePath(str, directory, confined, path)) {
+			return false;
+		}
+
+		// vertices without a color in the file take the color attribute
+		Color defaultColor(255, 255, 255);
+		const char *color = pMesh->Attribute("color");
+		if (color != NULL) {
+			sscanf(color, "%lf %lf %lf", &defaultColor.r, &defaultColor.g, &defaultColor.b);
+		}
+
+		imported = new ImportedMesh();
+		if (!importMeshFile(path, defaultColor, *imported)) {
+			delete imported;
+			imported = NULL;
+		}
+	}
+	else if ((str = pMesh->Attribute("stream")) != NULL) {
+		// only the triangle count is read here, the triangles while rendering
+		if (!meshFilePath(str, directory, confined, mesh->streamFile)) {
+			return false;
+		}
+		mesh->streamColor = Color(255, 255, 255);
+
+		const char *color = pMesh->Attribute("color");
+		if (color != NULL) {
+			sscanf(color, "%lf %lf %lf", &mesh->streamColor.r, &mesh->streamColor.g, &mesh->streamColor.b);
+		}
+
+		STLReader reader;
+		mesh->numberOfTriangles = 0;
+		if (reader.open(mesh->streamFile)) {
+			mesh->numberOfTriangles = reader.triangleCount;
+		}
+		return true;
+	}
+	else {
+		XMLElement *pFaces = pMesh->FirstChildElement("Faces");
+		parseFaces(pFaces != NULL ? pFaces->GetText() : NULL, mesh->triangles);
+	}
+
+	mesh->numberOfTriangles = mesh->triangles.size();
+	return true;
+}
+
+/*
+	Appends the vertices and colors of an imported mesh file to the scene
+	and gives mesh its triangles, renumbered to the scene's vertex ids.
+	The scene takes imported over and points into its arrays instead of
+	copying them, so a large file is held in memory only once.
+*/
+void Scene::addImportedMesh(ImportedMesh *imported, Mesh *mesh)
+{
+	int base = vertices.size();
+	int count = imported->vertices.size();
+
+	vertices.reserve(base + count);
+	colorsOfVertices.reserve(base + count);
+
+	for (int i = 0; i < count; i++)
+	{
+		Vec3 *vertex = &imported->vertices[i];
+		vertex->colorId = base + i + 1;
+
+		vertices.push_back(vertex);
+		colorsOfVertices.push_back(&imported->colors[i]);
+	}
+
+	// renumbered in place, indices outside the file's vertices would point into other meshes
+	vector<Triangle> &triangles = imported->triangles;
+	int kept = 0;
+	for (int i = 0; i < triangles.size(); i++)
+	{
+		int *ids = triangles[i].vertexIds;
+
+		if (ids[0] >= 1 && ids[0] <= count && ids[1] >= 1 && ids[1] <= count && ids[2] >= 1 && ids[2] <= count) {
+			triangles[kept++] = Triangle(ids[0] + base, ids[1] + base, ids[2] + base);
+		}
+	}
+	triangles.resize(kept);
+
+	mesh->triangles.swap(triangles);
+	mesh->numberOfTriangles = mesh->triangles.size();
+
+	importedGeometry.push_back(imported);
+}
+
+/*
+	Parses XML file
+*/
+Scene::Scene(const char *xmlPath)
+{
+	XMLDocument xmlDoc;
+	xmlDoc.LoadFile(xmlPath);
+
+	// mesh files are named relative to the directory of the XML file
+	string directory = xmlPath;
+	size_t slash = directory.find_last_of('/');
+	directory = slash == string::npos ? "" : directory.substr(0, slash + 1);
+
+	loaded = load(xmlDoc, directory, false);
+}
+
+/*
+	Parses a scene given as XML text, mesh files are looked up in directory.
+	A confined scene cannot name mesh files outside of directory.
+*/
+Scene::Scene(const string &xmlText, const string &directory, bool confineMeshFiles)
+{
+	XMLDocument xmlDoc;
+	xmlDoc.Parse(xmlText.c_str(), xmlText.size());
+
+	loaded = load(xmlDoc, directory, confineMeshFiles);
+}
+
+/*
+	Scene of a single OBJ or PLY file given without an XML file. The mesh
+	is drawn solid with the depth test by a perspective camera of
+	resolution x resolution pixels, looking down -z at its bounding box.
+	The image is written as the file name with a .ppm extension.
+*/
+Scene::Scene(const string &meshPath, int resolution)
+{
+	size_t slash = meshPath.find_last_of('/');
+	string directory = slash == string::npos ? "" : meshPath.substr(0, slash + 1);
+	string fileName = meshPath.substr(directory.size());
+	string outputName = fileName.substr(0, fileName.find_last_of('.')) + ".ppm";
+
+	// the camera is placed below, once the bounds of the mesh are known
+	XMLDocument xmlDoc;
+	xmlDoc.Parse("<Scene><BackgroundColor>0 0 0</BackgroundColor><DepthTest>enabled</DepthTest>"
+				 "<Cameras><Camera id=\"1\" type=\"perspective\"><Position>0 0 0</Position><Gaze>0 0 -1</Gaze><Up>0 1 0</Up>"
+				 "<ImagePlane>-1 1 -1 1 1 100 1 1</ImagePlane><OutputName>-</OutputName></Camera></Cameras>"
+				 "<Meshes><Mesh id=\"1\" type=\"solid\"/></Meshes></Scene>");
+
+	xmlDoc.RootElement()->FirstChildElement("Meshes")->FirstChildElement("Mesh")->SetAttribute("file", fileName.c_str());
+
+	loaded = load(xmlDoc, directory, false);
+	if (!loaded) {
+		return;
+	}
+
+	Mesh *mesh = meshes[0];
+	if (mesh->triangles.empty()) {
+		cerr << meshPath << " has no triangles" << endl;
+		loaded = false;
+		return;
+	}
+
+	// the 90 degree field of view holds the bounding sphere from twice its radius
+	Vec3 center = multiplyVec3WithScalar(addVec3(mesh->boundsMin, mesh->boundsMax), 0.5);
+	double radius = max(magnitudeOfVec3(subtractVec3(mesh->boundsMax, mesh->boundsMin)) / 2, 1e-6);
+
+	Camera *cam = cameras[0];
+	cam->pos = Vec3(center.x, center.y, center.z + 2 * radius, -1);
+	cam->computeBasis();
+	cam->near = radius / 2;
+	cam->far = 4 * radius;
+	cam->left = cam->bottom = -cam->near;
+	cam->right = cam->top = cam->near;
+	cam->horRes = cam->verRes = resolution;
+	cam->outputFileName = outputName;
+}
+
+bool Scene::load(XMLDocument &xmlDoc, const string &directory, bool confineMeshFiles)
+{
+	const char *str;
+	XMLElement *pElement;
+
+	overdrawEnabled = false;
+	pixelWrites = 0;
+	streamChunkSize = 65536;
+	lodEnabled = false;
+	lodThreshold = 1;
+	scissorEnabled = false;
+	drawXMin = drawYMin = drawXMax = drawYMax = 0;
+	threadCount = 0;
+	scheduler = NULL;
+	animation = NULL;
+	projectionKept = false;
+
+	if (xmlDoc.Error()) {
+		cerr << "cannot parse the scene: " << xmlDoc.ErrorName() << " at line " << xmlDoc.GetErrorLineNum() << endl;
+		return false;
+	}
+
+	XMLElement *pRoot = xmlDoc.RootElement();
+	if (pRoot == NULL) {
+		cerr << "the scene has no root element" << endl;
+		return false;
+	}
+
+	// read background color
+	str = requiredText(pRoot, "BackgroundColor");
+	if (str == NULL) {
+		return false;
+	}
+	sscanf(str, "%lf %lf %lf", &backgroundColor.r, &backgroundColor.g, &backgroundColor.b);
+
+	// read culling
+	cullingEnabled = false;
+	frontFaceWinding = 1;
+	pElement = pRoot->FirstChildElement("Culling");
+	if (pElement != NULL) {
+		cullingEnabled = enabledText(pElement);
+
+		// front faces are counter-clockwise on screen unless frontFace="cw"
+		str = pElement->Attribute("frontFace");
+		if (str != NULL && strcmp(str, "cw") == 0) {
+			frontFaceWinding = -1;
+		}
+	}
+
+	// read perspective correct interpolation, on unless the scene turns it off
+	perspectiveCorrectEnabled = true;
+	pElement = pRoot->FirstChildElement("PerspectiveCorrect");
+	if (pElement != NULL) {
+		perspectiveCorrectEnabled = enabledText(pElement);
+	}
+
+	// read depth test and what depends on it
+	depthTestEnabled = false;
+	occlusionCullingEnabled = false;
+	frontToBackEnabled = false;
+	depthPrepassEnabled = false;
+	if (enabledText(pRoot->FirstChildElement("DepthTest"))) {
+		depthTestEnabled = true;
+	}
+	if (enabledText(pRoot->FirstChildElement("OcclusionCulling"))) {
+		depthTestEnabled = true;
+		occlusionCullingEnabled = true;
+	}
+	if (enabledText(pRoot->FirstChildElement("DepthPrepass"))) {
+		depthTestEnabled = true;
+		depthPrepassEnabled = true;
+	}
+	if (enabledText(pRoot->FirstChildElement("FrontToBack"))) {
+		depthTestEnabled = true;
+		frontToBackEnabled = true;
+	}
+
+	// read framebuffer layout
+	tiledFramebufferEnabled = false;
+	pElement = pRoot->FirstChildElement("Framebuffer");
+	if (pElement != NULL && pElement->Attribute("layout", "tiled")) {
+		tiledFramebufferEnabled = true;
+	}
+
+	// read multisampling
+	multisampleCount = 1;
+	pElement = pRoot->FirstChildElement("Multisample");
+	if (pElement != NULL) {
+		pElement->QueryIntAttribute("samples", &multisampleCount);
+
+		if (!validSampleCount(multisampleCount)) {
+			cerr << "Multisample samples must be 1, 2, 4 or 8, multisampling is off" << endl;
+			multisampleCount = 1;
+		}
+	}
+
+	// samples are stored and resolved linearly, the tiled layout has no sample storage
+	if (tiledFramebufferEnabled && multisampleCount > 1) {
+		cerr << "<Framebuffer layout=\"tiled\"> cannot be used with <Multisample>" << endl;
+		return false;
+	}
+
+	// read cameras
+	pElement = pRoot->FirstChildElement("Cameras");
+	if (pElement == NULL) {
+		cerr << "the scene has no <Cameras>" << endl;
+		return false;
+	}
+	XMLElement *pCamera = pElement->FirstChildElement("Camera");
+	while (pCamera != NULL)
+	{
+		Camera *cam = cameraPool.create();
+
+		pCamera->QueryIntAttribute("id", &cam->cameraId);
+
+		// read projection type
+		str = pCamera->Attribute("type");
+
+		if (str != NULL && strcmp(str, "orthographic") == 0) {
+			cam->projectionType = 0;
+		}
+		else {
+			cam->projectionType = 1;
+		}
+
+		if ((str = requiredText(pCamera, "Position")) == NULL) {
+			return false;
+		}
+		sscanf(str, "%lf %lf %lf", &cam->pos.x, &cam->pos.y, &cam->pos.z);
+
+		if ((str = requiredText(pCamera, "Gaze")) == NULL) {
+			return false;
+		}
+		sscanf(str, "%lf %lf %lf", &cam->gaze.x, &cam->gaze.y, &cam->gaze.z);
+
+		if ((str = requiredText(pCamera, "Up")) == NULL) {
+			return false;
+		}
+		sscanf(str, "%lf %lf %lf", &cam->up.x, &cam->up.y, &cam->up.z);
+
+		cam->computeBasis();
+
+		if ((str = requiredText(pCamera, "ImagePlane")) == NULL) {
+			return false;
+		}
+		if (sscanf(str, "%lf %lf %lf %lf %lf %lf %d %d",
+				   &cam->left, &cam->right, &cam->bottom, &cam->top,
+				   &cam->near, &cam->far, &cam->horRes, &cam->verRes) != 8 || cam->horRes <= 0 || cam->verRes <= 0) {
+			cerr << "camera " << cam->cameraId << " has a malformed <ImagePlane>" << endl;
+			return false;
+		}
+
+		if ((str = requiredText(pCamera, "OutputName")) == NULL) {
+			return false;
+		}
+		cam->outputFileName = string(str);
+
+		cameras.push_back(cam);
+
+		pCamera = pCamera->NextSiblingElement("Camera");
+	}
+
+	// read vertices, scenes made only of mesh files may have none
+	pElement = pRoot->FirstChildElement("Vertices");
+	XMLElement *pVertex = pElement != NULL ? pElement->FirstChildElement("Vertex") : NULL;
+	int vertexId = 1;
+
+	// lay vertices and colors out in one block each
+	int vertexCount = 0;
+	for (XMLElement *p = pVertex; p != NULL; p = p->NextSiblingElement("Vertex")) {
+		vertexCount++;
+	}
+	vertexPool.reserve(vertexCount);
+	colorPool.reserve(vertexCount);
+	vertices.reserve(vertexCount);
+	colorsOfVertices.reserve(vertexCount);
+
+	while (pVertex != NULL)
+	{
+		Vec3 *vertex = vertexPool.create();
+		Color *color = colorPool.create();
+
+		vertex->colorId = vertexId;
+
+		if ((str = requiredAttribute(pVertex, "position")) == NULL) {
+			return false;
+		}
+		sscanf(str, "%lf %lf %lf", &vertex->x, &vertex->y, &vertex->z);
+
+		if ((str = requiredAttribute(pVertex, "color")) == NULL) {
+			return false;
+		}
+		sscanf(str, "%lf %lf %lf", &color->r, &color->g, &color->b);
+
+		vertices.push_back(vertex);
+		colorsOfVertices.push_back(color);
+
+		pVertex = pVertex->NextSiblingElement("Vertex");
+
+		vertexId++;
+	}
+
+	// read translations
+	pElement = pRoot->FirstChildElement("Translations");
+	XMLElement *pTranslation = pElement != NULL ? pElement->FirstChildElement("Translation") : NULL;
+	while (pTranslation != NULL)
+	{
+		Translation *translation = translationPool.create();
 
 		pTranslation->QueryIntAttribute("id", &translation->translationId);
 
-		str = pTranslation->Attribute("value");
+		if ((str = requiredAttribute(pTranslation, "value")) == NULL) {
+			return false;
+		}
 		sscanf(str, "%lf %lf %lf", &translation->tx, &translation->ty, &translation->tz);
 
 		translations.push_back(translation);
@@ -649,13 +2113,15 @@ Scene::Scene(const char *xmlPath)
 
 	// read scalings
 	pElement = pRoot->FirstChildElement("Scalings");
-	XMLElement *pScaling = pElement->FirstChildElement("Scaling");
+	XMLElement *pScaling = pElement != NULL ? pElement->FirstChildElement("Scaling") : NULL;
 	while (pScaling != NULL)
 	{
-		Scaling *scaling = new Scaling();
+		Scaling *scaling = scalingPool.create();
 
 		pScaling->QueryIntAttribute("id", &scaling->scalingId);
-		str = pScaling->Attribute("value");
+		if ((str = requiredAttribute(pScaling, "value")) == NULL) {
+			return false;
+		}
 		sscanf(str, "%lf %lf %lf", &scaling->sx, &scaling->sy, &scaling->sz);
 
 		scalings.push_back(scaling);
@@ -665,13 +2131,15 @@ Scene::Scene(const char *xmlPath)
 
 	// read rotations
 	pElement = pRoot->FirstChildElement("Rotations");
-	XMLElement *pRotation = pElement->FirstChildElement("Rotation");
+	XMLElement *pRotation = pElement != NULL ? pElement->FirstChildElement("Rotation") : NULL;
 	while (pRotation != NULL)
 	{
-		Rotation *rotation = new Rotation();
+		Rotation *rotation = rotationPool.create();
 
 		pRotation->QueryIntAttribute("id", &rotation->rotationId);
-		str = pRotation->Attribute("value");
+		if ((str = requiredAttribute(pRotation, "value")) == NULL) {
+			return false;
+		}
 		sscanf(str, "%lf %lf %lf %lf", &rotation->angle, &rotation->ux, &rotation->uy, &rotation->uz);
 
 		rotations.push_back(rotation);
@@ -679,69 +2147,257 @@ Scene::Scene(const char *xmlPath)
 		pRotation = pRotation->NextSiblingElement("Rotation");
 	}
 
-	// read meshes
+	// read meshes, elements are independent so their contents are parsed in parallel
 	pElement = pRoot->FirstChildElement("Meshes");
+	if (pElement == NULL) {
+		cerr << "the scene has no <Meshes>" << endl;
+		return false;
+	}
 
+	vector<XMLElement *> meshElements;
 	XMLElement *pMesh = pElement->FirstChildElement("Mesh");
-	XMLElement *meshElement;
 	while (pMesh != NULL)
 	{
-		Mesh *mesh = new Mesh();
+		meshElements.push_back(pMesh);
+		meshes.push_back(meshPool.create());
 
-		pMesh->QueryIntAttribute("id", &mesh->meshId);
+		pMesh = pMesh->NextSiblingElement("Mesh");
+	}
 
-		// read projection type
-		str = pMesh->Attribute("type");
+	vector<ImportedMesh *> importedMeshes(meshElements.size(), NULL);
+	vector<char> meshParsed(meshElements.size(), 0);
+	int threadCount = min((int)thread::hardware_concurrency(), (int)meshElements.size());
+	atomic<int> nextMesh(0);
 
-		if (strcmp(str, "wireframe") == 0) {
-			mesh->type = 0;
+	auto parseMeshes = [&]() {
+		for (int i = nextMesh++; i < meshElements.size(); i = nextMesh++) {
+			meshParsed[i] = parseMesh(meshElements[i], meshes[i], directory, confineMeshFiles, importedMeshes[i]);
 		}
-		else {
-			mesh->type = 1;
+	};
+
+	vector<thread> parsers;
+	for (int i = 1; i < threadCount; i++) {
+		parsers.push_back(thread(parseMeshes));
+	}
+	parseMeshes();
+	for (int i = 0; i < parsers.size(); i++) {
+		parsers[i].join();
+	}
+
+	for (int i = 0; i < meshElements.size(); i++) {
+		if (!meshParsed[i]) {
+			for (int j = 0; j < meshElements.size(); j++) {
+				delete importedMeshes[j];
+			}
+			return false;
 		}
+	}
 
-		// read mesh transformations
-		XMLElement *pTransformations = pMesh->FirstChildElement("Transformations");
-		XMLElement *pTransformation = pTransformations->FirstChildElement("Transformation");
+	// imported vertices go after the XML ones, in mesh order
+	for (int i = 0; i < meshElements.size(); i++) {
+		if (importedMeshes[i] != NULL) {
+			addImportedMesh(importedMeshes[i], meshes[i]);
+		}
+	}
 
-		while (pTransformation != NULL)
-		{
-			char transformationType;
-			int transformationId;
+	// point instances at the mesh holding their geometry, following instances of instances
+	map<int, Mesh *> meshesById;
+	for (int i = 0; i < meshes.size(); i++) {
+		meshesById[meshes[i]->meshId] = meshes[i];
+	}
 
-			str = pTransformation->GetText();
-			sscanf(str, "%c %d", &transformationType, &transformationId);
+	for (int i = 0; i < meshes.size(); i++) {
+		Mesh *geometry = meshes[i];
 
-			mesh->transformationTypes.push_back(transformationType);
-			mesh->transformationIds.push_back(transformationId);
+		for (int hops = 0; geometry != NULL && geometry->instanceOf != 0 && hops <= meshes.size(); hops++) {
+			map<int, Mesh *>::iterator found = meshesById.find(geometry->instanceOf);
+			geometry = found != meshesById.end() ? found->second : NULL;
+		}
 
-			pTransformation = pTransformation->NextSiblingElement("Transformation");
+		if (geometry == NULL || geometry->instanceOf != 0) {
+			cerr << "mesh " << meshes[i]->meshId << ": instanceOf does not lead to a mesh with faces" << endl;
+			geometry = meshes[i];
 		}
 
-		mesh->numberOfTransformations = mesh->transformationIds.size();
+		meshes[i]->geometry = geometry;
+		meshes[i]->numberOfTriangles = geometry->numberOfTriangles;
+	}
 
-		// read mesh faces
-		char *row;
-		char *clone_str;
-		int v1, v2, v3;
-		XMLElement *pFaces = pMesh->FirstChildElement("Faces");
-        str = pFaces->GetText();
-		clone_str = strdup(str);
+	for (int i = 0; i < meshes.size(); i++) {
+		if (meshes[i]->geometry == meshes[i]) {
+			meshes[i]->computeBounds(vertices);
+		}
+	}
+
+	// read level of detail, levels are built once all geometry is known
+	pElement = pRoot->FirstChildElement("LevelOfDetail");
+	if (pElement != NULL) {
+		int levelCount = 4;
+		double ratio = 0.5;
+
+		pElement->QueryIntAttribute("levels", &levelCount);
+		pElement->QueryDoubleAttribute("ratio", &ratio);
+		pElement->QueryDoubleAttribute("threshold", &lodThreshold);
+
+		if (ratio <= 0 || ratio >= 1) {
+			cerr << "LevelOfDetail ratio must be between 0 and 1, using 0.5" << endl;
+			ratio = 0.5;
+		}
+
+		buildLevelsOfDetail(levelCount, ratio);
+	}
+
+	// read animation
+	pElement = pRoot->FirstChildElement("Animation");
+	if (pElement != NULL)
+	{
+		// without the attribute there is a single frame
+		int frameCount = 1;
+		if (pElement->QueryIntAttribute("frameCount", &frameCount) == XML_WRONG_ATTRIBUTE_TYPE || frameCount < 1) {
+			cerr << "<Animation> frameCount must be a whole number of at least 1" << endl;
+			return false;
+		}
+		animation = new Animation(frameCount);
 
-		row = strtok(clone_str, "\n");
-		while (row != NULL)
+		XMLElement *pTrack = pElement->FirstChildElement("Track");
+		for (; pTrack != NULL; pTrack = pTrack->NextSiblingElement("Track"))
 		{
-			int result = sscanf(row, "%d %d %d", &v1, &v2, &v3);
-			
-			if (result != EOF) {
-				mesh->triangles.push_back(Triangle(v1, v2, v3));
+			AnimationTrack track;
+			pTrack->QueryIntAttribute("id", &track.targetId);
+
+			// read target, cameras animate one field per track
+			const char *target = pTrack->Attribute("target");
+			const char *field = pTrack->Attribute("field");
+
+			if (target == NULL) {
+				target = "(none)";
+			}
+
+			if (strcmp(target, "translation") == 0) {
+				track.targetType = TargetTranslation;
+			}
+			else if (strcmp(target, "scaling") == 0) {
+				track.targetType = TargetScaling;
+			}
+			else if (strcmp(target, "rotation") == 0) {
+				track.targetType = TargetRotation;
+			}
+			else if (strcmp(target, "camera") == 0 && field != NULL) {
+				if (strcmp(field, "position") == 0) {
+					track.targetType = TargetCameraPosition;
+				}
+				else if (strcmp(field, "gaze") == 0) {
+					track.targetType = TargetCameraGaze;
+				}
+				else if (strcmp(field, "up") == 0) {
+					track.targetType = TargetCameraUp;
+				}
+				else if (strcmp(field, "imagePlane") == 0) {
+					track.targetType = TargetCameraImagePlane;
+				}
+			}
+
+			if (track.targetType == TargetNone) {
+				cerr << "animation track with target " << target << " and field " << (field != NULL ? field : "(none)")
+					 << " is skipped, targets are translation, scaling, rotation or camera with field position, gaze, up or imagePlane" << endl;
+				continue;
+			}
+
+			if (track.targetId < 1 || track.targetId > track.targetCount(*this)) {
+				cerr << "animation track of " << target << " " << track.targetId << " is skipped, there is no such " << target << endl;
+				continue;
+			}
+
+			bool keyframesRead = true;
+			XMLElement *pKeyframe = pTrack->FirstChildElement("Keyframe");
+			while (pKeyframe != NULL)
+			{
+				Keyframe keyframe;
+
+				str = pKeyframe->Attribute("value");
+				if (pKeyframe->QueryIntAttribute("frame", &keyframe.frame) != XML_SUCCESS || str == NULL) {
+					keyframesRead = false;
+					break;
+				}
+				sscanf(str, "%lf %lf %lf %lf %lf %lf",
+					   &keyframe.values[0], &keyframe.values[1], &keyframe.values[2],
+					   &keyframe.values[3], &keyframe.values[4], &keyframe.values[5]);
+
+				// keep keyframes sorted by frame
+				int k = track.keyframes.size();
+				while (k > 0 && track.keyframes[k - 1].frame > keyframe.frame) {
+					k--;
+				}
+				track.keyframes.insert(track.keyframes.begin() + k, keyframe);
+
+				pKeyframe = pKeyframe->NextSiblingElement("Keyframe");
+			}
+
+			if (!keyframesRead) {
+				cerr << "animation track of " << target << " " << track.targetId << " is skipped, a keyframe has no frame or value" << endl;
+				continue;
+			}
+
+			if (!track.keyframes.empty()) {
+				animation->tracks.push_back(track);
 			}
-			row = strtok(NULL, "\n");
 		}
-		mesh->numberOfTriangles = mesh->triangles.size();
-		meshes.push_back(mesh);
+	}
 
-		pMesh = pMesh->NextSiblingElement("Mesh");
+	return true;
+}
+
+/*
+	Parsed objects live in the pools and are freed together with them
+*/
+Scene::~Scene()
+{
+	delete animation;
+	delete scheduler;
+
+	for (int i = 0; i < importedGeometry.size(); i++)
+	{
+		delete importedGeometry[i];
+	}
+}
+
+// the scheduler is started at first use, and again when threadCount changed
+TaskScheduler &Scene::taskScheduler()
+{
+	if (scheduler == NULL || schedulerThreadCount != threadCount)
+	{
+		delete scheduler;
+		scheduler = new TaskScheduler(threadCount);
+		schedulerThreadCount = threadCount;
+		rasterContexts.resize(scheduler->threadCount());
+	}
+	return *scheduler;
+}
+
+// sample counts with a pattern, 1 turns multisampling off
+bool Scene::validSampleCount(int samples)
+{
+	return samples == 1 || samples == 2 || samples == 4 || samples == 8;
+}
+
+/*
+	Sample positions of the standard Direct3D patterns, in 1/16 pixel from
+	the pixel center. Rotated grids resolve near horizontal and near vertical
+	edges better than a regular grid with as many samples.
+*/
+static void setSamplePattern(int samples, vector<double> &sampleX, vector<double> &sampleY)
+{
+	static const int pattern2[2][2] = {{4, 4}, {-4, -4}};
+	static const int pattern4[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+	static const int pattern8[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+	const int (*pattern)[2] = samples == 2 ? pattern2 : samples == 4 ? pattern4 : pattern8;
+
+	sampleX.resize(samples);
+	sampleY.resize(samples);
+	for (int s = 0; s < samples; s++)
+	{
+		sampleX[s] = pattern[s][0] / 16.0;
+		sampleY[s] = pattern[s][1] / 16.0;
 	}
 }
 
@@ -750,52 +2406,170 @@ Scene::Scene(const char *xmlPath)
 */
 void Scene::initializeImage(Camera *camera)
 {
+	// the image covers only the scissor (clamped to the camera), or the whole camera without one
+	drawXMin = 0;
+	drawYMin = 0;
+	drawXMax = camera->horRes;
+	drawYMax = camera->verRes;
+
+	if (scissorEnabled)
+	{
+		drawXMin = max(drawXMin, scissorXMin);
+		drawYMin = max(drawYMin, scissorYMin);
+		drawXMax = max(drawXMin, min(drawXMax, scissorXMax));
+		drawYMax = max(drawYMin, min(drawYMax, scissorYMax));
+	}
+
+	int width = drawXMax - drawXMin;
+	int height = drawYMax - drawYMin;
+
+	if (overdrawEnabled)
+	{
+		overdraw.assign(width, vector<int>(height, 0));
+	}
+	pixelWrites = 0;
+
+	// nothing drawn is infinitely far away
+	if (depthTestEnabled)
+	{
+		depth.assign(width, vector<double>(height, numeric_limits<double>::infinity()));
+	}
+	if (occlusionCullingEnabled)
+	{
+		depthPyramid.reset(width, height);
+	}
+
+	// the background is truncated to its level, shaded colors are rounded (see shadedLevel)
+	Color background(makeBetweenZeroAnd255(floor(backgroundColor.r)),
+					 makeBetweenZeroAnd255(floor(backgroundColor.g)),
+					 makeBetweenZeroAnd255(floor(backgroundColor.b)));
+
+	if (tiledFramebufferEnabled && multisampleCount == 1)
+	{
+		tiledImage.reset(width, height, background);
+	}
+
+	if (multisampleCount > 1)
+	{
+		setSamplePattern(multisampleCount, sampleX, sampleY);
+		sampleColors.assign((size_t)width * height * multisampleCount, background);
+		if (depthTestEnabled)
+		{
+			sampleDepths.assign((size_t)width * height * multisampleCount, numeric_limits<double>::infinity());
+		}
+	}
+
+	// cameras may have different resolutions, reallocate on mismatch
+	if (this->image.size() != width ||
+		(!this->image.empty() && this->image[0].size() != height))
+	{
+		this->image.clear();
+	}
+
 	if (this->image.empty())
 	{
-		for (int i = 0; i < camera->horRes; i++)
+		for (int i = 0; i < width; i++)
 		{
 			vector<Color> rowOfColors;
 
-			for (int j = 0; j < camera->verRes; j++)
+			for (int j = 0; j < height; j++)
 			{
-				rowOfColors.push_back(this->backgroundColor);
+				rowOfColors.push_back(background);
 			}
 
 			this->image.push_back(rowOfColors);
 		}
 	}
-	else
+	// tiled and multisampled images are overwritten as a whole after rasterizing
+	else if (!tiledFramebufferEnabled && multisampleCount == 1)
 	{
-		for (int i = 0; i < camera->horRes; i++)
+		for (int i = 0; i < width; i++)
 		{
-			for (int j = 0; j < camera->verRes; j++)
+			for (int j = 0; j < height; j++)
 			{
-				this->image[i][j].r = this->backgroundColor.r;
-				this->image[i][j].g = this->backgroundColor.g;
-				this->image[i][j].b = this->backgroundColor.b;
+				this->image[i][j] = background;
 			}
 		}
 	}
 }
 
 /*
-	If given value is less than 0, converts value to 0.
-	If given value is more than 255, converts value to 255.
-	Otherwise returns value itself.
+	Overdraw debug mode: replaces image with a false-color map of how many
+	times each pixel was written and prints a histogram of the counts
+	together with the writes of every mesh.
+	0 black, 1 blue, 2 cyan, 3 green, 4 yellow, 5-7 orange, 8-15 red, 16+ white
+*/
+void Scene::showOverdraw(Camera *camera)
+{
+	Color ramp[8] = {Color(0, 0, 0), Color(0, 0, 255), Color(0, 255, 255), Color(0, 255, 0),
+					 Color(255, 255, 0), Color(255, 128, 0), Color(255, 0, 0), Color(255, 255, 255)};
+	vector<long> histogram;
+	long coveredPixels = 0;
+
+	for (int i = 0; i < overdraw.size(); i++)
+	{
+		for (int j = 0; j < overdraw[i].size(); j++)
+		{
+			int count = overdraw[i][j];
+
+			if (count >= histogram.size())
+				histogram.resize(count + 1, 0);
+			histogram[count]++;
+
+			if (count > 0)
+				coveredPixels++;
+
+			int level = count <= 4 ? count : (count < 8 ? 5 : (count < 16 ? 6 : 7));
+			image[i][j] = ramp[level];
+		}
+	}
+
+	// the ratio's format is not left on cout
+	ios::fmtflags flags = cout.flags();
+	streamsize precision = cout.precision();
+
+	cout << "Overdraw of camera " << camera->cameraId << " (" << camera->outputFileName << "): "
+		 << pixelWrites << " writes to " << coveredPixels << " pixels, "
+		 << fixed << setprecision(2) << (coveredPixels ? (double)pixelWrites / coveredPixels : 0.0) << " per covered pixel" << endl;
+
+	cout.flags(flags);
+	cout.precision(precision);
+
+	for (int count = 0; count < histogram.size(); count++)
+	{
+		if (histogram[count] > 0)
+			cout << "\twritten " << count << " times: " << histogram[count] << " pixels" << endl;
+	}
+
+	for (int m = 0; m < meshPixelWrites.size(); m++)
+	{
+		cout << "\tmesh " << meshes[m]->meshId << ": " << meshPixelWrites[m] << " writes" << endl;
+	}
+}
+
+/*
+	Quantization of a single image color when it leaves the scene: clamps
+	to [0, 255] and rounds to the nearest level. writeImageToPPMFile does
+	the same for the whole image in one pass.
 */
 int Scene::makeBetweenZeroAnd255(double value)
 {
-	if (value >= 255.0)
-		return 255;
-	if (value <= 0.0)
-		return 0;
-	return (int)(value);
+	return (int)round(min(max(value, 0.0), 255.0));
 }
 
 /*
 	Writes contents of image (Color**) into a PPM file.
 */
 void Scene::writeImageToPPMFile(Camera *camera)
+{
+	writeImageToPPMFile(this->image, camera);
+}
+
+/*
+	Writes contents of the given image into the PPM file of camera.
+	Does not touch the scene, so it can run while the next image is rendered.
+*/
+void Scene::writeImageToPPMFile(const vector< vector<Color> > &image, Camera *camera)
 {
 	ofstream fout;
 
@@ -806,15 +2580,44 @@ void Scene::writeImageToPPMFile(Camera *camera)
 	fout << camera->horRes << " " << camera->verRes << endl;
 	fout << "255" << endl;
 
-	for (int j = camera->verRes - 1; j >= 0; j--)
+	// levels are written from a table of their text, a row at a time
+	static const vector<string> levelText = []() {
+		vector<string> text(256);
+		for (int level = 0; level < 256; level++)
+			text[level] = to_string(level) + " ";
+		return text;
+	}();
+	// one clamp and quantize pass over the image, column by column as it is stored
+	int width = camera->horRes, height = camera->verRes;
+	vector<unsigned char> levels((size_t)width * height * 3);
+
+	for (int i = 0; i < width; i++)
+	{
+		const Color *column = &image[i][0];
+		unsigned char *out = &levels[(size_t)i * height * 3];
+
+		for (int j = 0; j < height; j++)
+		{
+			out[3 * j] = (unsigned char)(min(max(column[j].r, 0.0), 255.0) + 0.5);
+			out[3 * j + 1] = (unsigned char)(min(max(column[j].g, 0.0), 255.0) + 0.5);
+			out[3 * j + 2] = (unsigned char)(min(max(column[j].b, 0.0), 255.0) + 0.5);
+		}
+	}
+
+	string row;
+
+	for (int j = height - 1; j >= 0; j--)
 	{
-		for (int i = 0; i < camera->horRes; i++)
+		row.clear();
+		for (int i = 0; i < width; i++)
 		{
-			fout << makeBetweenZeroAnd255(this->image[i][j].r) << " "
-				 << makeBetweenZeroAnd255(this->image[i][j].g) << " "
-				 << makeBetweenZeroAnd255(this->image[i][j].b) << " ";
+			const unsigned char *level = &levels[((size_t)i * height + j) * 3];
+			row += levelText[level[0]];
+			row += levelText[level[1]];
+			row += levelText[level[2]];
 		}
-		fout << endl;
+		row += '\n';
+		fout << row;
 	}
 	fout.close();
 }
@@ -4,13 +4,16 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "Animation.h"
 #include "Camera.h"
 #include "Color.h"
 #include "Mesh.h"
+#include "MeshImporter.h"
 #include "Rotation.h"
 #include "Scaling.h"
 #include "Translation.h"
@@ -18,16 +21,111 @@
 #include "Vec3.h"
 #include "Vec4.h"
 #include "Matrix4.h"
+#include "ObjectPool.h"
+#include "DepthPyramid.h"
+#include "RenderStats.h"
+#include "TaskScheduler.h"
+#include "TiledBuffer.h"
 
 using namespace std;
 
+namespace tinyxml2
+{
+	class XMLDocument;
+}
+
+// box on screen around the bounds of a mesh, zMin is the depth of their nearest point
+class MeshScreenBounds
+{
+public:
+	bool valid; // false when the mesh has no bounds or they reach behind the eye
+	double xMin, yMin, xMax, yMax, zMin;
+};
+
+/*
+	State of one thread that rasterizes. Screen tiles are rasterized in
+	parallel into one image, each clipped to its tile, and count their work
+	here to be summed after. Rasterizing on a single thread clips to the
+	draw area. A scene keeps one per scheduler thread.
+*/
+class RasterContext
+{
+public:
+	int clipXMin, clipYMin, clipXMax, clipYMax;
+	bool shadingPass; // triangles are shaded where their depth equals the prepass depth
+	const Color *streamColors; // of the streamed chunk being drawn, see Scene::vertexColor
+	long fragmentsShaded, fragmentsPrepassed, pixelWrites;
+
+	void begin(int xMin, int yMin, int xMax, int yMax)
+	{
+		clipXMin = xMin;
+		clipYMin = yMin;
+		clipXMax = xMax;
+		clipYMax = yMax;
+		shadingPass = false;
+		streamColors = NULL;
+		fragmentsShaded = 0;
+		fragmentsPrepassed = 0;
+		pixelWrites = 0;
+	}
+};
+
 class Scene
 {
 public:
 	Color backgroundColor;
 	bool cullingEnabled;
+	int frontFaceWinding; // 1 for counter-clockwise, -1 for clockwise front faces on screen
 
 	vector< vector<Color> > image;
+
+	// pixels are written to tiledImage, stored in tiles, and copied into image after rasterizing
+	bool tiledFramebufferEnabled;
+	TiledBuffer< Color > tiledImage;
+
+	// colors are interpolated with 1/w, which projected vertices carry in t, instead of linearly on screen
+	bool perspectiveCorrectEnabled;
+
+	// depth buffer laid out as image, fragments nearer than what was drawn (smaller depth) pass
+	bool depthTestEnabled;
+	vector< vector<double> > depth;
+
+	// meshes whose bounds lie behind what is already drawn are skipped, needs the depth test
+	bool occlusionCullingEnabled;
+	DepthPyramid depthPyramid;
+
+	// solid meshes are drawn nearest first, so hidden fragments fail the depth test early; needs the depth test
+	bool frontToBackEnabled;
+
+	// solid meshes are shaded only where they are visible, after a depth-only pass; needs the depth test
+	bool depthPrepassEnabled;
+
+	/*
+		Multisample anti-aliasing, 1 sample per pixel when off. Coverage and depth
+		are kept per sample, colors are shaded once per pixel and triangle, and
+		rasterizeGeometry resolves the samples into image. The samples of pixel
+		(x, y) start at ((x - drawXMin) * height + y - drawYMin) * samples.
+		With the depth test on, depth holds the farthest sample of each pixel,
+		for occlusion culling only.
+	*/
+	int multisampleCount;
+	vector< double > sampleX, sampleY; // offsets from the pixel center
+	vector< Color > sampleColors;
+	vector< double > sampleDepths;
+
+	// when enabled only [scissorXMin, scissorXMax) x [scissorYMin, scissorYMax) is rendered
+	bool scissorEnabled;
+	int scissorXMin, scissorYMin, scissorXMax, scissorYMax;
+
+	// part of the camera image held in image, pixel (x, y) is image[x - drawXMin][y - drawYMin]
+	int drawXMin, drawYMin, drawXMax, drawYMax;
+
+	// overdraw debug mode, counts pixel writes instead of showing colors
+	bool overdrawEnabled;
+	vector< vector<int> > overdraw;
+	vector< long > meshPixelWrites;
+	long pixelWrites;
+
 	vector< Camera* > cameras;
 	vector< Vec3* > vertices;
 	vector< Color* > colorsOfVertices;
@@ -35,14 +133,54 @@ public:
 	vector< Rotation* > rotations;
 	vector< Translation* > translations;
 	vector< Mesh* > meshes;
+	Animation *animation; // NULL when the input has no <Animation>
+	int streamChunkSize; // triangles read at once from streamed meshes
+	bool projectionKept; // projectGeometry kept the triangles, after prepareProjection they are projected while drawn
+	vector< vector<Vec4> > projectedMeshes; // per mesh, 3 vertices per triangle kept by projectGeometry
+	vector< Matrix4 > projectedTransforms; // per mesh, model to clip space for the projected camera
+	vector< int > projectedLevels; // per mesh, level of detail drawn, -1 for full detail
+	vector< MeshScreenBounds > projectedBounds; // per mesh, after perspective division
+	vector< int > drawOrder; // mesh indices in the order rasterizeGeometry draws them
+
+	// level of detail, each mesh is drawn with its coarsest level whose error stays under lodThreshold pixels
+	bool lodEnabled;
+	double lodThreshold;
+
+	RenderStats stats; // of the last projectGeometry
+
+	// threads that project meshes and rasterize screen tiles, 0 for all hardware threads
+	int threadCount;
+
+	bool loaded; // false when the input could not be parsed, the scene must then only be deleted
 
 	Scene(const char *xmlPath);
+	Scene(const string &xmlText, const string &directory, bool confineMeshFiles);
+	Scene(const string &meshPath, int resolution);
+	~Scene();
+
+	Scene(const Scene &other) = delete;
+	Scene &operator=(const Scene &other) = delete;
 
 	void initializeImage(Camera* camera);
+	void setScissor(int xMin, int yMin, int xMax, int yMax);
+	void clearScissor();
 	void forwardRenderingPipeline(Camera* camera);
-	int makeBetweenZeroAnd255(double value);
+	void prepareProjection(Camera* camera);
+	void projectMesh(int m, Matrix4 &Mviewp, vector<Vec4> &projected, RenderStats &counts);
+	void projectGeometry(Camera* camera);
+	void rasterizeGeometry(Camera* camera);
+	void rasterizeMeshes(Camera* camera, Matrix4 &Mviewp);
+	void rasterizeTiles(Camera* camera, Matrix4 &Mviewp);
+	void orderMeshes();
+	bool meshOccluded(int m, Matrix4 &Mviewp, int &xMin, int &yMin, int &xMax, int &yMax);
+	void showOverdraw(Camera* camera);
+	void buildLevelsOfDetail(int levelCount, double ratio);
+	bool projectBounds(Mesh *mesh, Matrix4 &Mtransform, MeshScreenBounds &bounds);
+	int selectLevelOfDetail(Mesh *mesh, MeshScreenBounds &bounds, Matrix4 &Mviewp);
+	static int makeBetweenZeroAnd255(double value);
 	void writeImageToPPMFile(Camera* camera);
-	void convertPPMToPNG(string ppmFileName, int osType);
+	static void writeImageToPPMFile(const vector< vector<Color> > &image, Camera* camera);
+	static void convertPPMToPNG(string ppmFileName, int osType);
 	Matrix4 getModelingTransform(Mesh & mesh);
 	Matrix4 getRotationMatrix(Rotation * r);
 	Matrix4 getScalingMatrix(Scaling * s);
@@ -50,12 +188,47 @@ public:
 	Matrix4 getOrtographicProjection(Camera *camera);
 	Matrix4 getPerspectiveProjection(Camera *camera);
 	Matrix4 getViewportMatrix(Camera *camera);
-	void lineRasterizer(Vec4 &vec1, Vec4 &vec2);
-	void midpoint1(Vec4 &vec1, Vec4 &vec2);
-	void midpoint2(Vec4 &vec1, Vec4 &vec2);
-	bool clipping(Vec4 &vec1, Vec4 &vec2, int nx, int ny);
-	void triangleRasterizer(Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny);
+	Matrix4 getViewingTransform(Camera *camera);
+	void rasterizeTriangle(RasterContext &raster, int type, Vec4 &vertex1, Vec4 &vertex2, Vec4 &vertex3, Camera *camera);
+	void streamMesh(Mesh *mesh, Matrix4 &Mtransform, Matrix4 &Mviewp, const function<void(vector<Vec4> &, vector<Color> &)> &drawChunk);
+	const Color &vertexColor(RasterContext &raster, int colorId);
+	bool insideDrawArea(RasterContext &raster, int x, int y);
+	void writePixel(RasterContext &raster, int x, int y, Color &color);
+	bool depthTest(int x, int y, double z);
+	bool depthEqualTest(int x, int y, double z);
+	void writeSamples(RasterContext &raster, int x, int y, unsigned mask, Color &color, double z, double dzdx, double dzdy);
+	void keepFarthestSample(int x, int y);
+	void lineSamples(RasterContext &raster, int x, int y, bool xMajor, Vec4 &from, double slope, Color &color, double z);
+	void resolveSamples();
+	static bool validSampleCount(int samples);
+	void lineRasterizer(RasterContext &raster, Vec4 &vec1, Vec4 &vec2);
+	void midpoint1(RasterContext &raster, Vec4 &vec1, Vec4 &vec2);
+	void midpoint2(RasterContext &raster, Vec4 &vec1, Vec4 &vec2);
+	bool clipping(RasterContext &raster, Vec4 &vec1, Vec4 &vec2, int nx, int ny);
+	void triangleRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny);
+	void triangleDepthRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, int nx, int ny);
+	void triangleSampleRasterizer(RasterContext &raster, Vec4 &v0, Vec4 &v1, Vec4 &v2, bool depthOnly);
 	double lineEquation(double xp, double yp, double x1, double y1, double x2, double y2);
+
+private:
+	// own every object the pointer vectors above refer to
+	ObjectPool< Camera > cameraPool;
+	ObjectPool< Vec3 > vertexPool;
+	ObjectPool< Color > colorPool;
+	ObjectPool< Scaling > scalingPool;
+	ObjectPool< Rotation > rotationPool;
+	ObjectPool< Translation > translationPool;
+	ObjectPool< Mesh > meshPool;
+	vector< ImportedMesh * > importedGeometry; // mesh files, their vertices and colors are used in place
+
+	TaskScheduler *scheduler;
+	int schedulerThreadCount; // threadCount the scheduler was started with
+	vector< RasterContext > rasterContexts; // per scheduler thread, the calling thread's first
+
+	TaskScheduler &taskScheduler();
+
+	bool load(tinyxml2::XMLDocument &xmlDoc, const string &directory, bool confineMeshFiles);
+	void addImportedMesh(ImportedMesh *imported, Mesh *mesh);
 };
 
 #endif
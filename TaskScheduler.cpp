@@ -0,0 +1,171 @@
+#include <chrono>
+#include "TaskScheduler.h"
+
+using namespace std;
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+TaskScheduler::TaskScheduler(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+    }
+
+    this->task = NULL;
+    this->batch = 0;
+    this->running = 0;
+    this->stopping = false;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        this->queues.push_back(new TaskQueue());
+    }
+
+    // the caller of run is thread 0
+    for (int i = 1; i < threadCount; i++)
+    {
+        this->threads.push_back(thread(&TaskScheduler::serve, this, i));
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        lock_guard<mutex> lock(this->batchMutex);
+        this->stopping = true;
+        this->batchStarted.notify_all();
+    }
+
+    for (int i = 0; i < this->threads.size(); i++)
+    {
+        this->threads[i].join();
+    }
+
+    for (int i = 0; i < this->queues.size(); i++)
+    {
+        delete this->queues[i];
+    }
+}
+
+int TaskScheduler::threadCount() const
+{
+    return this->queues.size();
+}
+
+void TaskScheduler::run(int taskCount, const function<void(int, int)> &task, vector<double> &busyMs, vector<double> &idleMs)
+{
+    int threadCount = this->queues.size();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        for (int index = (long)taskCount * t / threadCount; index < (long)taskCount * (t + 1) / threadCount; index++)
+        {
+            this->queues[t]->tasks.push_back(index);
+        }
+    }
+
+    this->task = &task;
+    this->batchBusyMs.assign(threadCount, 0);
+
+    // a single task or thread is run here without waking anyone
+    if (threadCount > 1 && taskCount > 1)
+    {
+        lock_guard<mutex> lock(this->batchMutex);
+        this->batch++;
+        this->running = threadCount - 1;
+        this->batchStarted.notify_all();
+    }
+
+    work(0);
+
+    {
+        unique_lock<mutex> lock(this->batchMutex);
+        this->batchFinished.wait(lock, [this] { return this->running == 0; });
+    }
+
+    double batchMs = millisecondsSince(start);
+
+    busyMs.resize(threadCount, 0);
+    idleMs.resize(threadCount, 0);
+    for (int t = 0; t < threadCount; t++)
+    {
+        busyMs[t] += this->batchBusyMs[t];
+        idleMs[t] += batchMs - this->batchBusyMs[t];
+    }
+}
+
+void TaskScheduler::serve(int self)
+{
+    int seen = 0;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(this->batchMutex);
+            this->batchStarted.wait(lock, [this, seen] { return this->stopping || this->batch != seen; });
+            if (this->stopping)
+            {
+                return;
+            }
+            seen = this->batch;
+        }
+
+        work(self);
+
+        lock_guard<mutex> lock(this->batchMutex);
+        if (--this->running == 0)
+        {
+            this->batchFinished.notify_all();
+        }
+    }
+}
+
+// runs tasks until no deque has any left, tasks are never added during a batch
+void TaskScheduler::work(int self)
+{
+    int index;
+
+    while (take(self, index))
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        (*this->task)(index, self);
+        this->batchBusyMs[self] += millisecondsSince(start);
+    }
+}
+
+bool TaskScheduler::take(int self, int &index)
+{
+    int threadCount = this->queues.size();
+
+    for (int k = 0; k < threadCount; k++)
+    {
+        TaskQueue *queue = this->queues[(self + k) % threadCount];
+        lock_guard<mutex> lock(queue->lock);
+
+        if (queue->tasks.empty())
+        {
+            continue;
+        }
+
+        // own tasks from the back, stolen ones from the front, away from where the owner works
+        if (k == 0)
+        {
+            index = queue->tasks.back();
+            queue->tasks.pop_back();
+        }
+        else
+        {
+            index = queue->tasks.front();
+            queue->tasks.pop_front();
+        }
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,66 @@
+#ifndef __TASK_SCHEDULER_H__
+#define __TASK_SCHEDULER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+    Runs batches of independent tasks on a fixed set of threads with work
+    stealing. Every thread has its own deque of task indices, dealt out as
+    one contiguous run per thread. A thread takes tasks from the back of
+    its own deque and, once that is empty, steals from the front of the
+    others', so threads that drew cheap tasks help the ones that drew
+    expensive tasks instead of idling until the batch ends.
+    The thread calling run works as thread 0.
+*/
+class TaskScheduler
+{
+public:
+    // threadCount 0 uses every hardware thread
+    TaskScheduler(int threadCount);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler &other) = delete;
+    TaskScheduler &operator=(const TaskScheduler &other) = delete;
+
+    int threadCount() const;
+
+    /*
+        Calls task(index, threadIndex) for every index in [0, taskCount) and
+        returns once all calls returned. Tasks must not call run. The
+        milliseconds each thread spent in tasks are added to busyMs, the
+        rest of the batch to idleMs; both are resized to threadCount.
+    */
+    void run(int taskCount, const function<void(int, int)> &task, vector<double> &busyMs, vector<double> &idleMs);
+
+private:
+    class TaskQueue
+    {
+    public:
+        mutex lock;
+        deque<int> tasks;
+    };
+
+    vector<TaskQueue *> queues;
+    vector<thread> threads;
+    vector<double> batchBusyMs;
+    const function<void(int, int)> *task;
+
+    mutex batchMutex;
+    condition_variable batchStarted, batchFinished;
+    int batch;   // counts started batches, threads wait for the next one
+    int running; // helper threads still working on the batch
+    bool stopping;
+
+    void serve(int self);
+    void work(int self);
+    bool take(int self, int &index);
+};
+
+#endif
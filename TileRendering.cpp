@@ -0,0 +1,535 @@
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Scene.h"
+#include "TileRendering.h"
+
+using namespace std;
+
+// largest scene text and directory name a worker accepts, anything longer ends the session
+static const int maxSceneLength = 1 << 28;
+static const int maxDirectoryLength = 4096;
+
+class Tile
+{
+public:
+    int xMin, yMin, xMax, yMax;
+};
+
+static bool sendAll(int socket, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+
+    while (size > 0)
+    {
+        ssize_t sent = send(socket, p, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        p += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool receiveAll(int socket, void *data, size_t size)
+{
+    char *p = (char *)data;
+
+    while (size > 0)
+    {
+        ssize_t received = recv(socket, p, size, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        p += received;
+        size -= received;
+    }
+    return true;
+}
+
+static bool sendInts(int socket, const int *values, int count)
+{
+    uint32_t message[8];
+
+    for (int i = 0; i < count; i++)
+    {
+        message[i] = htonl((uint32_t)values[i]);
+    }
+    return sendAll(socket, message, count * sizeof(uint32_t));
+}
+
+static bool receiveInts(int socket, int *values, int count)
+{
+    uint32_t message[8];
+
+    if (!receiveAll(socket, message, count * sizeof(uint32_t)))
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        values[i] = (int)ntohl(message[i]);
+    }
+    return true;
+}
+
+static bool sendString(int socket, const string &text)
+{
+    int length = text.size();
+    return sendInts(socket, &length, 1) && sendAll(socket, text.data(), text.size());
+}
+
+static bool receiveString(int socket, string &text, int maxLength)
+{
+    int length;
+    if (!receiveInts(socket, &length, 1) || length < 0 || length > maxLength)
+    {
+        return false;
+    }
+
+    text.resize(length);
+    return length == 0 || receiveAll(socket, &text[0], length);
+}
+
+/*
+    Coordinator
+*/
+
+TileCoordinator::TileCoordinator(int tileSize)
+{
+    this->tileSize = tileSize > 0 ? tileSize : 1;
+}
+
+TileCoordinator::~TileCoordinator()
+{
+    for (int i = 0; i < this->sockets.size(); i++)
+    {
+        if (this->sockets[i] >= 0)
+        {
+            int end[6] = {0, -1, 0, 0, 0, 0};
+            sendInts(this->sockets[i], end, 6);
+            closeWorker(i);
+        }
+    }
+
+    for (int i = 0; i < this->children.size(); i++)
+    {
+        waitpid(this->children[i], NULL, 0);
+    }
+}
+
+bool TileCoordinator::spawnLocalWorkers(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+        {
+            perror("socketpair");
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            close(pair[0]);
+            close(pair[1]);
+            return false;
+        }
+
+        if (pid == 0)
+        {
+            // the worker keeps only its own end, so it sees the coordinator exit
+            close(pair[0]);
+            for (int j = 0; j < this->sockets.size(); j++)
+            {
+                if (this->sockets[j] >= 0)
+                {
+                    close(this->sockets[j]);
+                }
+            }
+
+            _exit(serveTileWorker(pair[1], NULL) ? 0 : 1);
+        }
+
+        close(pair[1]);
+        this->sockets.push_back(pair[0]);
+        this->children.push_back(pid);
+    }
+
+    return true;
+}
+
+bool TileCoordinator::connectWorker(const string &host, int port)
+{
+    struct addrinfo hints, *addresses;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ostringstream service;
+    service << port;
+
+    if (getaddrinfo(host.c_str(), service.str().c_str(), &hints, &addresses) != 0)
+    {
+        cerr << "cannot resolve worker " << host << endl;
+        return false;
+    }
+
+    int connected = -1;
+    for (struct addrinfo *a = addresses; a != NULL && connected < 0; a = a->ai_next)
+    {
+        int s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s < 0)
+        {
+            continue;
+        }
+
+        if (connect(s, a->ai_addr, a->ai_addrlen) == 0)
+        {
+            connected = s;
+        }
+        else
+        {
+            close(s);
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (connected < 0)
+    {
+        cerr << "cannot connect to worker " << host << ":" << port << endl;
+        return false;
+    }
+
+    // tile requests are small and answered one at a time
+    int noDelay = 1;
+    setsockopt(connected, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    this->sockets.push_back(connected);
+    return true;
+}
+
+bool TileCoordinator::sendScene(const string &xmlText, const string &directory)
+{
+    for (int i = 0; i < this->sockets.size(); i++)
+    {
+        if (this->sockets[i] >= 0 && !(sendString(this->sockets[i], xmlText) && sendString(this->sockets[i], directory)))
+        {
+            cerr << "worker " << i << " did not take the scene" << endl;
+            closeWorker(i);
+        }
+    }
+
+    // all workers parse at the same time, then each reports whether it could
+    for (int i = 0; i < this->sockets.size(); i++)
+    {
+        int status = -1;
+        if (this->sockets[i] >= 0 && (!receiveInts(this->sockets[i], &status, 1) || status != 0))
+        {
+            cerr << "worker " << i << " could not load the scene" << endl;
+            closeWorker(i);
+        }
+    }
+
+    return workerCount() > 0;
+}
+
+bool TileCoordinator::render(int frame, int cameraIndex, int xMin, int yMin, int xMax, int yMax, vector< vector<Color> > &image)
+{
+    deque<Tile> tiles;
+    mutex tilesMutex;
+
+    for (int y = yMin; y < yMax; y += this->tileSize)
+    {
+        for (int x = xMin; x < xMax; x += this->tileSize)
+        {
+            Tile tile;
+            tile.xMin = x;
+            tile.yMin = y;
+            tile.xMax = min(x + this->tileSize, xMax);
+            tile.yMax = min(y + this->tileSize, yMax);
+            tiles.push_back(tile);
+        }
+    }
+
+    // one thread per worker, each keeps its worker busy with the next free tile
+    auto serve = [&](int worker) {
+        int socket = this->sockets[worker];
+        vector<unsigned char> pixels;
+
+        while (true)
+        {
+            Tile tile;
+            {
+                lock_guard<mutex> lock(tilesMutex);
+                if (tiles.empty())
+                {
+                    return;
+                }
+                tile = tiles.front();
+                tiles.pop_front();
+            }
+
+            int request[6] = {frame, cameraIndex, tile.xMin, tile.yMin, tile.xMax, tile.yMax};
+            int width = tile.xMax - tile.xMin, height = tile.yMax - tile.yMin;
+            int status = -1;
+
+            pixels.resize((size_t)width * height * 3);
+
+            if (!sendInts(socket, request, 6) || !receiveInts(socket, &status, 1) || status != 0 ||
+                !receiveAll(socket, &pixels[0], pixels.size()))
+            {
+                // another worker takes the tile over
+                cerr << "worker " << worker << " failed, its tiles go to the others" << endl;
+                {
+                    lock_guard<mutex> lock(tilesMutex);
+                    tiles.push_back(tile);
+                }
+                closeWorker(worker);
+                return;
+            }
+
+            // tiles do not overlap, so threads write image without a lock
+            const unsigned char *p = &pixels[0];
+            for (int j = tile.yMin; j < tile.yMax; j++)
+            {
+                for (int i = tile.xMin; i < tile.xMax; i++, p += 3)
+                {
+                    image[i - xMin][j - yMin] = Color(p[0], p[1], p[2]);
+                }
+            }
+        }
+    };
+
+    // tiles handed back by a failing worker may be left after the others finished
+    while (!tiles.empty() && workerCount() > 0)
+    {
+        vector<thread> threads;
+        for (int i = 0; i < this->sockets.size(); i++)
+        {
+            if (this->sockets[i] >= 0)
+            {
+                threads.push_back(thread(serve, i));
+            }
+        }
+        for (int i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+    }
+
+    return tiles.empty();
+}
+
+int TileCoordinator::workerCount()
+{
+    int count = 0;
+    for (int i = 0; i < this->sockets.size(); i++)
+    {
+        if (this->sockets[i] >= 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void TileCoordinator::closeWorker(int worker)
+{
+    close(this->sockets[worker]);
+    this->sockets[worker] = -1;
+}
+
+/*
+    Worker
+*/
+
+bool serveTileWorker(int socket, const char *rootDirectory)
+{
+    string xmlText, directory;
+    if (!receiveString(socket, xmlText, maxSceneLength) || !receiveString(socket, directory, maxDirectoryLength))
+    {
+        close(socket);
+        return false;
+    }
+
+    // a worker with its own root ignores the coordinator's directory and stays below the root
+    Scene *scene = rootDirectory != NULL ? new Scene(xmlText, rootDirectory, true) : new Scene(xmlText, directory, false);
+
+    int status = scene->loaded ? 0 : 1;
+    if (!sendInts(socket, &status, 1) || !scene->loaded)
+    {
+        delete scene;
+        close(socket);
+        return false;
+    }
+
+    // tiles are already rendered in parallel by the worker processes
+    scene->threadCount = 1;
+    vector<unsigned char> pixels;
+    int appliedFrame = -1;
+    int projectedFrame = -1, projectedCamera = -1;
+    bool ended = false;
+
+    while (true)
+    {
+        int request[6];
+        if (!receiveInts(socket, request, 6))
+        {
+            break;
+        }
+
+        int frame = request[0], cameraIndex = request[1];
+        if (cameraIndex < 0)
+        {
+            ended = true;
+            break;
+        }
+
+        int xMin = request[2], yMin = request[3], xMax = request[4], yMax = request[5];
+
+        if (cameraIndex >= scene->cameras.size() || xMin < 0 || yMin < 0 || xMax <= xMin || yMax <= yMin ||
+            xMax > scene->cameras[cameraIndex]->horRes || yMax > scene->cameras[cameraIndex]->verRes)
+        {
+            int status = 1;
+            if (!sendInts(socket, &status, 1))
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (scene->animation != NULL && frame != appliedFrame)
+        {
+            scene->animation->applyFrame(*scene, frame);
+            appliedFrame = frame;
+        }
+
+        Camera *camera = scene->cameras[cameraIndex];
+
+        // geometry is projected once per camera and frame, tiles only rasterize it
+        if (frame != projectedFrame || cameraIndex != projectedCamera)
+        {
+            scene->projectGeometry(camera);
+            projectedFrame = frame;
+            projectedCamera = cameraIndex;
+        }
+
+        // the worker's image is only as large as the tile
+        scene->setScissor(xMin, yMin, xMax, yMax);
+        scene->initializeImage(camera);
+        scene->rasterizeGeometry(camera);
+
+        pixels.resize((size_t)(xMax - xMin) * (yMax - yMin) * 3);
+        unsigned char *p = &pixels[0];
+        for (int j = yMin; j < yMax; j++)
+        {
+            for (int i = xMin; i < xMax; i++)
+            {
+                Color &color = scene->image[i - xMin][j - yMin];
+                *p++ = Scene::makeBetweenZeroAnd255(color.r);
+                *p++ = Scene::makeBetweenZeroAnd255(color.g);
+                *p++ = Scene::makeBetweenZeroAnd255(color.b);
+            }
+        }
+
+        int status = 0;
+        if (!sendInts(socket, &status, 1) || !sendAll(socket, &pixels[0], pixels.size()))
+        {
+            break;
+        }
+    }
+
+    delete scene;
+    close(socket);
+    return ended;
+}
+
+int runTileWorker(const string &bindAddress, int port, const string &rootDirectory)
+{
+    struct addrinfo hints, *addresses;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    ostringstream service;
+    service << port;
+
+    if (getaddrinfo(bindAddress.c_str(), service.str().c_str(), &hints, &addresses) != 0)
+    {
+        cerr << "cannot resolve bind address " << bindAddress << endl;
+        return 1;
+    }
+
+    int listener = -1;
+    for (struct addrinfo *a = addresses; a != NULL && listener < 0; a = a->ai_next)
+    {
+        int s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s < 0)
+        {
+            continue;
+        }
+
+        int reuse = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        if (bind(s, a->ai_addr, a->ai_addrlen) == 0 && listen(s, 4) == 0)
+        {
+            listener = s;
+        }
+        else
+        {
+            close(s);
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (listener < 0)
+    {
+        perror("bind");
+        return 1;
+    }
+
+    // mesh files are looked up below the root, relative names below the working directory
+    string root = rootDirectory;
+    if (!root.empty() && root[root.size() - 1] != '/')
+    {
+        root += '/';
+    }
+
+    cerr << "worker listening on " << bindAddress << ":" << port << endl;
+
+    while (true)
+    {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0)
+        {
+            continue;
+        }
+
+        int noDelay = 1;
+        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        if (!serveTileWorker(connection, root.c_str()))
+        {
+            cerr << "coordinator session failed" << endl;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __TILE_RENDERING_H__
+#define __TILE_RENDERING_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "Color.h"
+
+using namespace std;
+
+/*
+    Renders camera images split into tiles on worker processes.
+
+    The coordinator sends the scene's XML text to every worker once, then
+    hands out tiles to whichever worker is free. A worker renders a tile
+    with the ordinary pipeline under a scissor and sends back its pixels.
+    Messages, all integers 32 bit in network byte order:
+        scene:  text length, text, directory length, directory
+        loaded: status (0 when the worker could load the scene)
+        tile:   frame, camera index, xMin, yMin, xMax, yMax (camera index -1 ends the session)
+        reply:  status (0 when rendered), then the tile's pixels as r g b bytes,
+                (xMax - xMin) per row, rows from yMin up
+    Workers are either forked from the coordinator and talk over a socket
+    pair, or run elsewhere as "rasterizer --worker <port>" and are reached
+    over TCP. A TCP worker reads mesh files only below its own root
+    directory, never the directory the coordinator sends.
+*/
+class TileCoordinator
+{
+public:
+    TileCoordinator(int tileSize);
+    ~TileCoordinator();
+
+    TileCoordinator(const TileCoordinator &other) = delete;
+    TileCoordinator &operator=(const TileCoordinator &other) = delete;
+
+    // forks count worker processes, call before any other thread is started
+    bool spawnLocalWorkers(int count);
+    bool connectWorker(const string &host, int port);
+
+    // directory is where the workers look for mesh files named by the scene
+    bool sendScene(const string &xmlText, const string &directory);
+
+    /*
+        Fills image with [xMin, xMax) x [yMin, yMax) of the camera's rendering,
+        image[x - xMin][y - yMin] must exist for every pixel of the region.
+        Tiles of a worker that fails are given to the others; returns false
+        when no worker is left to finish the image.
+    */
+    bool render(int frame, int cameraIndex, int xMin, int yMin, int xMax, int yMax, vector< vector<Color> > &image);
+
+    int workerCount();
+
+private:
+    int tileSize;
+    vector<int> sockets; // -1 once the worker failed
+    vector<pid_t> children;
+
+    void closeWorker(int worker);
+};
+
+/*
+    Serves one coordinator over socket until it ends the session, false when
+    the connection broke or the scene could not be loaded. Mesh files are
+    looked up in the coordinator's directory, or only below rootDirectory
+    unless it is NULL.
+*/
+bool serveTileWorker(int socket, const char *rootDirectory);
+
+/*
+    Accepts coordinators on bindAddress:port one after the other, returns
+    only when the port cannot be used. Mesh files are looked up below
+    rootDirectory, the working directory when it is empty.
+*/
+int runTileWorker(const string &bindAddress, int port, const string &rootDirectory);
+
+#endif
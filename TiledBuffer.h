@@ -0,0 +1,79 @@
+#ifndef __TILED_BUFFER_H__
+#define __TILED_BUFFER_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/*
+    A width x height buffer stored in square tiles of tileSize x tileSize
+    values. Tiles, and the values inside a tile, are laid out column by
+    column like the [x][y] buffers of the scene, but neighbouring pixels in
+    either direction share a tile: a tall or a wide triangle touches about
+    as many cache lines per pixel. Tiles at the right and top edges are
+    padded to full size.
+*/
+template <typename T>
+class TiledBuffer
+{
+public:
+    static const int tileShift = 3;
+    static const int tileSize = 1 << tileShift;
+
+    TiledBuffer()
+    {
+        this->width = 0;
+        this->height = 0;
+        this->tilesY = 0;
+    }
+
+    // sizes the buffer for width x height values, all set to value
+    void reset(int width, int height, const T &value)
+    {
+        this->width = width;
+        this->height = height;
+        this->tilesY = (height + tileSize - 1) >> tileShift;
+
+        size_t tilesX = (width + tileSize - 1) >> tileShift;
+        this->values.assign(tilesX * this->tilesY * tileSize * tileSize, value);
+    }
+
+    T &at(int x, int y)
+    {
+        size_t tile = (size_t)(x >> tileShift) * this->tilesY + (y >> tileShift);
+        return this->values[(tile << (2 * tileShift)) + ((x & (tileSize - 1)) << tileShift) + (y & (tileSize - 1))];
+    }
+
+    /*
+        Copies the values into buffer[x][y], which must be width x height.
+        Each column of a tile is one contiguous run in both layouts.
+    */
+    void detile(vector< vector<T> > &buffer) const
+    {
+        const T *tile = this->values.data();
+
+        for (int tileX = 0; tileX < this->width; tileX += tileSize)
+        {
+            for (int tileY = 0; tileY < this->height; tileY += tileSize, tile += tileSize * tileSize)
+            {
+                int columns = min(tileSize, this->width - tileX);
+                int rows = min(tileSize, this->height - tileY);
+
+                for (int i = 0; i < columns; i++)
+                {
+                    const T *column = tile + (i << tileShift);
+                    copy(column, column + rows, buffer[tileX + i].begin() + tileY);
+                }
+            }
+        }
+    }
+
+private:
+    int width, height;
+    int tilesY;
+    vector<T> values;
+};
+
+#endif
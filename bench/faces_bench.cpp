@@ -0,0 +1,110 @@
+/*
+    Parse rate of <Faces> text: the former strdup + strtok + sscanf loop
+    against parseFaces. Run as:
+        ./faces_bench [rows] [repetitions]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "FaceParser.h"
+#include "Triangle.h"
+
+using namespace std;
+
+static int legacyParseFaces(const char *str, vector<Triangle> &triangles)
+{
+    char *row;
+    char *clone_str;
+    int v1, v2, v3;
+    clone_str = strdup(str);
+
+    row = strtok(clone_str, "\n");
+    while (row != NULL)
+    {
+        int result = sscanf(row, "%d %d %d", &v1, &v2, &v3);
+
+        if (result != EOF) {
+            triangles.push_back(Triangle(v1, v2, v3));
+        }
+        row = strtok(NULL, "\n");
+    }
+    free(clone_str);
+
+    return triangles.size();
+}
+
+// Faces text as exporters write it: indented rows, a blank line now and then
+static string makeFacesText(int rows)
+{
+    string text = "\n";
+    char row[64];
+    unsigned int seed = 12345;
+
+    for (int i = 0; i < rows; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int base = 1 + (seed >> 8) % 1000000;
+        snprintf(row, sizeof(row), "\t\t\t%d %d %d\n", base, base + 1, base + 2);
+        text += row;
+
+        if (i % 1000 == 999)
+        {
+            text += "\t\t\t\n";
+        }
+    }
+
+    return text + "\t\t";
+}
+
+template <typename Parser>
+static double bestSeconds(Parser parse, const string &text, int repetitions, vector<Triangle> &triangles)
+{
+    double best = 1e30;
+
+    for (int r = 0; r < repetitions; r++)
+    {
+        triangles.clear();
+        triangles.shrink_to_fit();
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        parse(text.c_str(), triangles);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        if (elapsed.count() < best)
+        {
+            best = elapsed.count();
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int rows = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+
+    string text = makeFacesText(rows);
+    double megabytes = text.size() / 1e6;
+
+    vector<Triangle> legacy, fast;
+    double legacySeconds = bestSeconds(legacyParseFaces, text, repetitions, legacy);
+    double fastSeconds = bestSeconds(parseFaces, text, repetitions, fast);
+
+    bool same = legacy.size() == fast.size();
+    for (size_t i = 0; same && i < legacy.size(); i++)
+    {
+        same = memcmp(legacy[i].vertexIds, fast[i].vertexIds, sizeof(legacy[i].vertexIds)) == 0;
+    }
+
+    cout << "faces text: " << rows << " rows, " << megabytes << " MB" << endl;
+    cout << "strtok+sscanf: " << legacySeconds * 1000 << " ms, " << megabytes / legacySeconds << " MB/s" << endl;
+    cout << "parseFaces:    " << fastSeconds * 1000 << " ms, " << megabytes / fastSeconds << " MB/s" << endl;
+    cout << "speedup: " << legacySeconds / fastSeconds << "x, results " << (same ? "match" : "DIFFER") << endl;
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+/*
+    Golden image regression runner. Renders every XML scene in a directory,
+    compares each camera's image against the reference image of the same
+    name and reports correctness together with load and render times:
+        {"scene": ..., "camera": ..., "status": "pass", "max_diff": ...,
+         "bad_pixels": ..., "load_ms": ..., "render_ms": ...}
+    A channel differing by more than the tolerance makes a bad pixel. For
+    failing cameras the rendered image and a diff image (bad pixels red,
+    others the darkened reference) are written to the output directory.
+    A scene that cannot be loaded gives one "load_error" record and counts
+    as failed.
+    --update writes the rendered images as the new references instead.
+    Exits with 1 when any camera fails. Run as:
+        ./golden_bench <scene dir> <reference dir> [--tolerance <n>] [--out <dir>] [--update]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "Scene.h"
+
+using namespace std;
+
+class ReferenceImage
+{
+public:
+    int width, height;
+    vector<int> rgb; // top row first, as stored in the file
+
+    ReferenceImage()
+    {
+        this->width = 0;
+        this->height = 0;
+    }
+
+    // reads P3 and P6 files, returns false when missing or malformed
+    bool read(const string &path)
+    {
+        ifstream fin(path.c_str(), ios::binary);
+        string magic;
+        int maxValue;
+
+        if (!(fin >> magic) || (magic != "P3" && magic != "P6"))
+            return false;
+
+        if (!readHeaderInt(fin, this->width) || !readHeaderInt(fin, this->height) || !readHeaderInt(fin, maxValue))
+            return false;
+
+        this->rgb.resize(this->width * this->height * 3);
+
+        if (magic == "P6")
+        {
+            fin.get();
+            vector<unsigned char> bytes(this->rgb.size());
+            fin.read((char *)&bytes[0], bytes.size());
+            copy(bytes.begin(), bytes.end(), this->rgb.begin());
+            return fin.good();
+        }
+
+        for (size_t i = 0; i < this->rgb.size(); i++)
+        {
+            if (!(fin >> this->rgb[i]))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    static bool readHeaderInt(ifstream &fin, int &value)
+    {
+        fin >> ws;
+        while (fin.peek() == '#')
+        {
+            string comment;
+            getline(fin, comment);
+            fin >> ws;
+        }
+        return (bool)(fin >> value);
+    }
+};
+
+static string baseName(const string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// writes image with the given file name, keeping the camera's resolution
+static void writeImage(const vector< vector<Color> > &image, Camera *camera, const string &path)
+{
+    Camera output(*camera);
+    output.outputFileName = path;
+    Scene::writeImageToPPMFile(image, &output);
+}
+
+int main(int argc, char *argv[])
+{
+    vector<string> directories;
+    string outDir = "golden_out";
+    int tolerance = 0;
+    bool update = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = atoi(argv[++i]);
+        else if (arg == "--out" && i + 1 < argc)
+            outDir = argv[++i];
+        else if (arg == "--update")
+            update = true;
+        else
+            directories.push_back(arg);
+    }
+
+    if (directories.size() != 2)
+    {
+        cerr << "usage: " << argv[0] << " <scene dir> <reference dir> [--tolerance <n>] [--out <dir>] [--update]" << endl;
+        return 1;
+    }
+
+    string sceneDir = directories[0], referenceDir = directories[1];
+    vector<string> scenes;
+
+    DIR *dir = opendir(sceneDir.c_str());
+    if (dir == NULL)
+    {
+        cerr << "cannot open " << sceneDir << endl;
+        return 1;
+    }
+    for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.substr(name.size() - 4) == ".xml")
+            scenes.push_back(name);
+    }
+    closedir(dir);
+    sort(scenes.begin(), scenes.end());
+
+    mkdir(update ? referenceDir.c_str() : outDir.c_str(), 0755);
+
+    int passed = 0, failed = 0;
+
+    for (size_t s = 0; s < scenes.size(); s++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Scene *scene = new Scene((sceneDir + "/" + scenes[s]).c_str());
+        double loadMs = millisecondsSince(start);
+
+        // a scene that did not load has nothing trustworthy to render
+        if (!scene->loaded)
+        {
+            failed++;
+            printf("{\"scene\": \"%s\", \"status\": \"load_error\", \"load_ms\": %.3f}\n", scenes[s].c_str(), loadMs);
+            delete scene;
+            continue;
+        }
+
+        for (size_t c = 0; c < scene->cameras.size(); c++)
+        {
+            Camera *camera = scene->cameras[c];
+            string imageName = baseName(camera->outputFileName);
+
+            start = chrono::steady_clock::now();
+            scene->initializeImage(camera);
+            scene->forwardRenderingPipeline(camera);
+            double renderMs = millisecondsSince(start);
+
+            if (update)
+            {
+                writeImage(scene->image, camera, referenceDir + "/" + imageName);
+                printf("{\"scene\": \"%s\", \"camera\": %d, \"status\": \"updated\", \"load_ms\": %.3f, \"render_ms\": %.3f}\n",
+                       scenes[s].c_str(), camera->cameraId, loadMs, renderMs);
+                continue;
+            }
+
+            ReferenceImage reference;
+            const char *status = "pass";
+            int maxDiff = 0;
+            long badPixels = 0;
+
+            if (!reference.read(referenceDir + "/" + imageName) ||
+                reference.width != camera->horRes || reference.height != camera->verRes)
+            {
+                status = "missing";
+                badPixels = (long)camera->horRes * camera->verRes;
+            }
+            else
+            {
+                vector< vector<Color> > diff = scene->image;
+
+                for (int j = 0; j < camera->verRes; j++)
+                {
+                    for (int i = 0; i < camera->horRes; i++)
+                    {
+                        // PPM rows run from the top of the image down
+                        int *expected = &reference.rgb[((camera->verRes - 1 - j) * camera->horRes + i) * 3];
+                        Color &pixel = scene->image[i][j];
+                        int actual[3] = {Scene::makeBetweenZeroAnd255(pixel.r),
+                                         Scene::makeBetweenZeroAnd255(pixel.g),
+                                         Scene::makeBetweenZeroAnd255(pixel.b)};
+                        int pixelDiff = 0;
+
+                        for (int k = 0; k < 3; k++)
+                            pixelDiff = max(pixelDiff, abs(actual[k] - expected[k]));
+
+                        maxDiff = max(maxDiff, pixelDiff);
+
+                        if (pixelDiff > tolerance)
+                        {
+                            badPixels++;
+                            diff[i][j] = Color(255, 0, 0);
+                        }
+                        else
+                        {
+                            diff[i][j] = Color(expected[0] / 4, expected[1] / 4, expected[2] / 4);
+                        }
+                    }
+                }
+
+                if (badPixels > 0)
+                {
+                    status = "fail";
+                    writeImage(scene->image, camera, outDir + "/" + imageName);
+                    writeImage(diff, camera, outDir + "/diff_" + imageName);
+                }
+            }
+
+            if (badPixels > 0)
+                failed++;
+            else
+                passed++;
+
+            printf("{\"scene\": \"%s\", \"camera\": %d, \"status\": \"%s\", \"max_diff\": %d, \"bad_pixels\": %ld, "
+                   "\"load_ms\": %.3f, \"render_ms\": %.3f}\n",
+                   scenes[s].c_str(), camera->cameraId, status, maxDiff, badPixels, loadMs, renderMs);
+        }
+
+        delete scene;
+    }
+
+    if (!update)
+    {
+        cerr << passed << " passed, " << failed << " failed" << endl;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
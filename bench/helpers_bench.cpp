@@ -0,0 +1,269 @@
+/*
+    Throughput and latency of the math kernels in Helpers.cpp on randomized
+    inputs. Throughput runs independent calls back to back, latency feeds
+    each result into the next call through a "+ 0.0 * previous" dependency
+    (the "dependency chain" row shows what that link costs on its own).
+    The "(ref)" rows are by-reference candidates kept next to the current
+    by-value helpers so changes to the math layer can be compared directly.
+    Run as:
+        ./helpers_bench [iterations]
+*/
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Helpers.h"
+#include "Matrix4.h"
+#include "Vec3.h"
+#include "Vec4.h"
+
+using namespace std;
+
+#define INPUT_COUNT 1024
+#define INPUT_MASK (INPUT_COUNT - 1)
+
+class Inputs
+{
+public:
+    vector<Matrix4> matrices;
+    vector<Vec4> vec4s;
+    vector<Vec3> vec3s;
+    vector<double> scalars;
+
+    Inputs()
+    {
+        mt19937 random(477);
+        uniform_real_distribution<double> value(-10.0, 10.0);
+
+        for (int i = 0; i < INPUT_COUNT; i++)
+        {
+            Matrix4 m;
+            for (int r = 0; r < 4; r++)
+                for (int c = 0; c < 4; c++)
+                    m.val[r][c] = value(random);
+
+            matrices.push_back(m);
+            vec4s.push_back(Vec4(value(random), value(random), value(random), 1 + fabs(value(random)), -1));
+            vec3s.push_back(Vec3(value(random), value(random), value(random), -1));
+            scalars.push_back(value(random));
+        }
+    }
+};
+
+/*
+    By-reference candidates, kept out of line like the helpers they compete with.
+*/
+__attribute__((noinline)) void multiplyMatrixWithMatrixRef(const Matrix4 &m1, const Matrix4 &m2, Matrix4 &result)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            result.val[i][j] = m1.val[i][0] * m2.val[0][j] + m1.val[i][1] * m2.val[1][j] +
+                               m1.val[i][2] * m2.val[2][j] + m1.val[i][3] * m2.val[3][j];
+        }
+    }
+}
+
+__attribute__((noinline)) void multiplyMatrixWithVec4Ref(const Matrix4 &m, const Vec4 &v, Vec4 &result)
+{
+    result.x = m.val[0][0] * v.x + m.val[0][1] * v.y + m.val[0][2] * v.z + m.val[0][3] * v.t;
+    result.y = m.val[1][0] * v.x + m.val[1][1] * v.y + m.val[1][2] * v.z + m.val[1][3] * v.t;
+    result.z = m.val[2][0] * v.x + m.val[2][1] * v.y + m.val[2][2] * v.z + m.val[2][3] * v.t;
+    result.t = m.val[3][0] * v.x + m.val[3][1] * v.y + m.val[3][2] * v.z + m.val[3][3] * v.t;
+    result.colorId = v.colorId;
+}
+
+__attribute__((noinline)) void crossProductVec3Ref(const Vec3 &a, const Vec3 &b, Vec3 &result)
+{
+    result.x = a.y * b.z - b.y * a.z;
+    result.y = b.x * a.z - a.x * b.z;
+    result.z = a.x * b.y - b.x * a.y;
+}
+
+__attribute__((noinline)) void normalizeVec3Ref(const Vec3 &v, Vec3 &result)
+{
+    double inverse = 1.0 / sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    result.x = v.x * inverse;
+    result.y = v.y * inverse;
+    result.z = v.z * inverse;
+}
+
+/*
+    A kernel makes one call on input i, adds carry * 0.0 to one of its
+    arguments and returns one element of the result.
+*/
+#define KERNEL(name, ...)                                         \
+    struct name                                                   \
+    {                                                             \
+        static inline double run(Inputs &in, int i, double carry) \
+        __VA_ARGS__                                               \
+    };
+
+KERNEL(DependencyChain, { return in.scalars[i] + carry * 0.0; })
+
+KERNEL(MatrixMatrix, {
+    Matrix4 a = in.matrices[i];
+    a.val[0][0] += carry * 0.0;
+    return multiplyMatrixWithMatrix(a, in.matrices[(i + 1) & INPUT_MASK]).val[0][0];
+})
+
+KERNEL(MatrixMatrixRef, {
+    Matrix4 a = in.matrices[i], result;
+    a.val[0][0] += carry * 0.0;
+    multiplyMatrixWithMatrixRef(a, in.matrices[(i + 1) & INPUT_MASK], result);
+    return result.val[0][0];
+})
+
+KERNEL(MatrixVec4, {
+    Vec4 v = in.vec4s[i];
+    v.x += carry * 0.0;
+    return multiplyMatrixWithVec4(in.matrices[i], v).x;
+})
+
+KERNEL(MatrixVec4Ref, {
+    Vec4 v = in.vec4s[i], result;
+    v.x += carry * 0.0;
+    multiplyMatrixWithVec4Ref(in.matrices[i], v, result);
+    return result.x;
+})
+
+KERNEL(Normalize, {
+    Vec3 v = in.vec3s[i];
+    v.x += carry * 0.0;
+    return normalizeVec3(v).x;
+})
+
+KERNEL(NormalizeRef, {
+    Vec3 v = in.vec3s[i], result;
+    v.x += carry * 0.0;
+    normalizeVec3Ref(v, result);
+    return result.x;
+})
+
+KERNEL(CrossProduct, {
+    Vec3 a = in.vec3s[i];
+    a.x += carry * 0.0;
+    return crossProductVec3(a, in.vec3s[(i + 1) & INPUT_MASK]).x;
+})
+
+KERNEL(CrossProductRef, {
+    Vec3 a = in.vec3s[i], result;
+    a.x += carry * 0.0;
+    crossProductVec3Ref(a, in.vec3s[(i + 1) & INPUT_MASK], result);
+    return result.x;
+})
+
+KERNEL(DotProduct, {
+    Vec3 a = in.vec3s[i];
+    a.x += carry * 0.0;
+    return dotProductVec3(a, in.vec3s[(i + 1) & INPUT_MASK]);
+})
+
+KERNEL(Magnitude, {
+    Vec3 a = in.vec3s[i];
+    a.x += carry * 0.0;
+    return magnitudeOfVec3(a);
+})
+
+KERNEL(SubtractVec3, {
+    Vec3 a = in.vec3s[i];
+    a.x += carry * 0.0;
+    return subtractVec3(a, in.vec3s[(i + 1) & INPUT_MASK]).x;
+})
+
+KERNEL(AddVec4, {
+    Vec4 a = in.vec4s[i];
+    a.x += carry * 0.0;
+    return addVec4(a, in.vec4s[(i + 1) & INPUT_MASK]).x;
+})
+
+KERNEL(SubtractVec4, {
+    Vec4 a = in.vec4s[i];
+    a.x += carry * 0.0;
+    return subtractVec4(a, in.vec4s[(i + 1) & INPUT_MASK]).x;
+})
+
+KERNEL(ScaleVec4, {
+    Vec4 a = in.vec4s[i];
+    a.x += carry * 0.0;
+    return multiplyVec4WithScalar(a, in.scalars[i]).x;
+})
+
+KERNEL(PerspectiveDivision, {
+    Vec4 a = in.vec4s[i];
+    a.x += carry * 0.0;
+    perspectiveDivision(a);
+    return a.x;
+})
+
+KERNEL(ConvertVec3, {
+    Vec4 a = in.vec4s[i];
+    a.x += carry * 0.0;
+    return convertVec3(a).x;
+})
+
+static double nanosecondsPerCall(chrono::steady_clock::time_point start, long iterations)
+{
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+template <typename Kernel>
+void measure(const char *name, Inputs &in, long iterations)
+{
+    volatile double sink;
+
+    // independent calls
+    double sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long n = 0; n < iterations; n++)
+    {
+        sum += Kernel::run(in, n & INPUT_MASK, 0.0);
+    }
+    double throughput = nanosecondsPerCall(start, iterations);
+    sink = sum;
+
+    // every call waits for the previous result
+    double carry = 0;
+    start = chrono::steady_clock::now();
+    for (long n = 0; n < iterations; n++)
+    {
+        carry = Kernel::run(in, n & INPUT_MASK, carry);
+    }
+    double latency = nanosecondsPerCall(start, iterations);
+    sink = carry;
+    (void)sink;
+
+    printf("%-32s %12.1f %14.2f %14.2f\n", name, 1000.0 / throughput, throughput, latency);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 20000000;
+    Inputs in;
+
+    printf("%-32s %12s %14s %14s\n", "kernel", "Mcalls/s", "ns/call", "latency ns");
+
+    measure<DependencyChain>("dependency chain", in, iterations);
+    measure<MatrixMatrix>("multiplyMatrixWithMatrix", in, iterations);
+    measure<MatrixMatrixRef>("multiplyMatrixWithMatrix (ref)", in, iterations);
+    measure<MatrixVec4>("multiplyMatrixWithVec4", in, iterations);
+    measure<MatrixVec4Ref>("multiplyMatrixWithVec4 (ref)", in, iterations);
+    measure<Normalize>("normalizeVec3", in, iterations);
+    measure<NormalizeRef>("normalizeVec3 (ref)", in, iterations);
+    measure<CrossProduct>("crossProductVec3", in, iterations);
+    measure<CrossProductRef>("crossProductVec3 (ref)", in, iterations);
+    measure<DotProduct>("dotProductVec3", in, iterations);
+    measure<Magnitude>("magnitudeOfVec3", in, iterations);
+    measure<SubtractVec3>("subtractVec3", in, iterations);
+    measure<AddVec4>("addVec4", in, iterations);
+    measure<SubtractVec4>("subtractVec4", in, iterations);
+    measure<ScaleVec4>("multiplyVec4WithScalar", in, iterations);
+    measure<PerspectiveDivision>("perspectiveDivision", in, iterations);
+    measure<ConvertVec3>("convertVec3", in, iterations);
+
+    return 0;
+}
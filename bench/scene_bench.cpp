@@ -0,0 +1,411 @@
+/*
+    Generates scenes in the XML input format at several sizes and runs the
+    whole Scene pipeline on them. Prints one JSON object per case:
+        {"scene": ..., "size": ..., "triangles": ..., "load_ms": ...,
+         "render_ms": ..., "triangles_per_sec": ..., "pixels_per_sec": ...,
+         "peak_rss_kb": ...}
+    Every case runs in its own process so peak RSS belongs to that case.
+    With --instanced, repeated meshes are written as instances of the
+    first one instead of carrying their own copy of the faces.
+    --layout picks the framebuffer layout the images are rendered into.
+    With "both" every case runs linear and then tiled, and the JSON lines
+    carry a "layout" field.
+    Run as:
+        ./scene_bench [--dir <scene directory>] [--res <width> <height>] [--quick] [--instanced]
+                      [--layout linear|tiled|both]
+*/
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Scene.h"
+
+using namespace std;
+
+class SceneDescription
+{
+public:
+    string name; // prefix of the output file names
+    bool instanced; // repeated meshes refer to the first one instead of copying its faces
+
+    SceneDescription()
+    {
+        this->instanced = false;
+    }
+    vector<string> cameras;
+    vector<string> vertices;
+    vector<string> translations;
+    vector<string> scalings;
+    vector<string> rotations;
+    vector<string> meshes;
+
+    int addVertex(double x, double y, double z, double r, double g, double b)
+    {
+        ostringstream os;
+        os << "<Vertex id=\"" << vertices.size() + 1 << "\" position=\"" << x << " " << y << " " << z
+           << "\" color=\"" << r << " " << g << " " << b << "\"/>";
+        vertices.push_back(os.str());
+        return vertices.size();
+    }
+
+    int addTranslation(double x, double y, double z)
+    {
+        ostringstream os;
+        os << "<Translation id=\"" << translations.size() + 1 << "\" value=\"" << x << " " << y << " " << z << "\"/>";
+        translations.push_back(os.str());
+        return translations.size();
+    }
+
+    int addScaling(double x, double y, double z)
+    {
+        ostringstream os;
+        os << "<Scaling id=\"" << scalings.size() + 1 << "\" value=\"" << x << " " << y << " " << z << "\"/>";
+        scalings.push_back(os.str());
+        return scalings.size();
+    }
+
+    int addRotation(double angle, double x, double y, double z)
+    {
+        ostringstream os;
+        os << "<Rotation id=\"" << rotations.size() + 1 << "\" value=\"" << angle << " " << x << " " << y << " " << z << "\"/>";
+        rotations.push_back(os.str());
+        return rotations.size();
+    }
+
+    // camera at pos looking at the origin
+    void addCamera(double x, double y, double z, double halfWidth, int horRes, int verRes)
+    {
+        double halfHeight = halfWidth * verRes / horRes;
+        ostringstream os;
+        os << "<Camera id=\"" << cameras.size() + 1 << "\" type=\"perspective\">"
+           << "<Position>" << x << " " << y << " " << z << "</Position>"
+           << "<Gaze>" << -x << " " << -y << " " << -z << "</Gaze>"
+           << "<Up>0 1 0</Up>"
+           << "<ImagePlane>" << -halfWidth << " " << halfWidth << " " << -halfHeight << " " << halfHeight
+           << " 1 1000 " << horRes << " " << verRes << "</ImagePlane>"
+           << "<OutputName>" << name << "_" << cameras.size() + 1 << ".ppm</OutputName></Camera>";
+        cameras.push_back(os.str());
+    }
+
+    void addMesh(bool solid, const string &transformations, const string &faces)
+    {
+        ostringstream os;
+        os << "<Mesh id=\"" << meshes.size() + 1 << "\" type=\"" << (solid ? "solid" : "wireframe") << "\">"
+           << "<Transformations>" << transformations << "</Transformations>"
+           << "<Faces>" << faces << "</Faces></Mesh>";
+        meshes.push_back(os.str());
+    }
+
+    // another placement of the faces of the first mesh
+    void addRepeatedMesh(bool solid, const string &transformations, const string &faces)
+    {
+        if (!instanced || meshes.empty())
+        {
+            addMesh(solid, transformations, faces);
+            return;
+        }
+
+        ostringstream os;
+        os << "<Mesh id=\"" << meshes.size() + 1 << "\" type=\"" << (solid ? "solid" : "wireframe") << "\" instanceOf=\"1\">"
+           << "<Transformations>" << transformations << "</Transformations></Mesh>";
+        meshes.push_back(os.str());
+    }
+
+    void write(const string &path)
+    {
+        ofstream fout(path.c_str());
+        fout << "<Scene>\n<BackgroundColor>0 0 0</BackgroundColor>\n<Culling>enabled</Culling>\n";
+        writeBlock(fout, "Cameras", cameras);
+        writeBlock(fout, "Vertices", vertices);
+        writeBlock(fout, "Translations", translations);
+        writeBlock(fout, "Scalings", scalings);
+        writeBlock(fout, "Rotations", rotations);
+        writeBlock(fout, "Meshes", meshes);
+        fout << "</Scene>\n";
+    }
+
+private:
+    void writeBlock(ofstream &fout, const char *name, vector<string> &items)
+    {
+        fout << "<" << name << ">\n";
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            fout << items[i] << "\n";
+        }
+        fout << "</" << name << ">\n";
+    }
+};
+
+static string transformation(char type, int id)
+{
+    ostringstream os;
+    os << "<Transformation>" << type << " " << id << "</Transformation>";
+    return os.str();
+}
+
+// unit cube around the origin, returns its faces text
+static string addCube(SceneDescription &scene)
+{
+    int base = scene.vertices.size();
+    for (int i = 0; i < 8; i++)
+    {
+        scene.addVertex(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1, i & 1 ? 255 : 40, i & 2 ? 255 : 40, i & 4 ? 255 : 40);
+    }
+
+    static const int faces[12][3] = {{0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6}, {0, 1, 5}, {0, 5, 4},
+                                     {2, 6, 7}, {2, 7, 3}, {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+    ostringstream os;
+    os << "\n";
+    for (int i = 0; i < 12; i++)
+    {
+        os << base + faces[i][0] + 1 << " " << base + faces[i][1] + 1 << " " << base + faces[i][2] + 1 << "\n";
+    }
+    return os.str();
+}
+
+// unit UV sphere with 2 * tessellation^2 triangles, returns its faces text
+static string addSphere(SceneDescription &scene, int tessellation)
+{
+    int base = scene.vertices.size();
+    for (int i = 0; i <= tessellation; i++)
+    {
+        double theta = M_PI * i / tessellation;
+        for (int j = 0; j < tessellation; j++)
+        {
+            double phi = 2 * M_PI * j / tessellation;
+            scene.addVertex(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi),
+                            128 + 127 * cos(phi), 128 + 127 * sin(theta), 128 + 127 * cos(theta));
+        }
+    }
+
+    ostringstream os;
+    os << "\n";
+    for (int i = 0; i < tessellation; i++)
+    {
+        for (int j = 0; j < tessellation; j++)
+        {
+            int a = base + i * tessellation + j + 1;
+            int b = base + i * tessellation + (j + 1) % tessellation + 1;
+            int c = a + tessellation;
+            int d = b + tessellation;
+            os << a << " " << b << " " << d << "\n" << a << " " << d << " " << c << "\n";
+        }
+    }
+    return os.str();
+}
+
+// n x n cubes on a plane
+static void makeGrid(SceneDescription &scene, int n, int horRes, int verRes)
+{
+    string cube = addCube(scene);
+    int scaling = scene.addScaling(0.4, 0.4, 0.4);
+
+    for (int x = 0; x < n; x++)
+    {
+        for (int y = 0; y < n; y++)
+        {
+            int t = scene.addTranslation(x - (n - 1) / 2.0, y - (n - 1) / 2.0, 0);
+            scene.addRepeatedMesh(true, transformation('s', scaling) + transformation('t', t), cube);
+        }
+    }
+
+    scene.addCamera(0, 0, n * 1.1, 0.55, horRes, verRes);
+}
+
+// a single sphere at the given tessellation
+static void makeSphere(SceneDescription &scene, int tessellation, int horRes, int verRes)
+{
+    string sphere = addSphere(scene, tessellation);
+    int rotation = scene.addRotation(30, 1, 1, 0);
+
+    scene.addMesh(true, transformation('r', rotation), sphere);
+    scene.addCamera(0, 0, 3, 0.5, horRes, verRes);
+}
+
+// n overlapping spheres alternating solid and wireframe
+static void makeMixed(SceneDescription &scene, int n, int horRes, int verRes)
+{
+    string sphere = addSphere(scene, 24);
+
+    for (int i = 0; i < n; i++)
+    {
+        double angle = 2 * M_PI * i / n;
+        int t = scene.addTranslation(0.8 * cos(angle), 0.8 * sin(angle), -0.05 * i);
+        scene.addRepeatedMesh(i % 2 == 0, transformation('t', t), sphere);
+    }
+
+    scene.addCamera(0, 0, 6, 0.5, horRes, verRes);
+}
+
+// n cameras on a circle around one sphere
+static void makeCameras(SceneDescription &scene, int n, int horRes, int verRes)
+{
+    string sphere = addSphere(scene, 32);
+    scene.addMesh(true, "", sphere);
+
+    for (int i = 0; i < n; i++)
+    {
+        double angle = 2 * M_PI * i / n;
+        scene.addCamera(4 * cos(angle), 1, 4 * sin(angle), 0.4, horRes, verRes);
+    }
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// loads and renders one scene, prints its JSON line; layout is empty when not compared
+static void runCase(const string &kind, int size, const string &path, const string &layout)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Scene *scene = new Scene(path.c_str());
+    double loadMs = millisecondsSince(start);
+
+    if (!layout.empty())
+    {
+        scene->tiledFramebufferEnabled = layout == "tiled";
+    }
+
+    long triangles = 0, pixels = 0;
+    start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < scene->cameras.size(); i++)
+    {
+        scene->initializeImage(scene->cameras[i]);
+        scene->forwardRenderingPipeline(scene->cameras[i]);
+
+        for (size_t j = 0; j < scene->meshes.size(); j++)
+        {
+            triangles += scene->meshes[j]->numberOfTriangles;
+        }
+        pixels += (long)scene->cameras[i]->horRes * scene->cameras[i]->verRes;
+    }
+
+    double renderMs = millisecondsSince(start);
+    delete scene;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    string layoutField = layout.empty() ? "" : "\"layout\": \"" + layout + "\", ";
+
+    printf("{\"scene\": \"%s\", \"size\": %d, %s\"triangles\": %ld, \"pixels\": %ld, "
+           "\"load_ms\": %.3f, \"render_ms\": %.3f, \"triangles_per_sec\": %.0f, "
+           "\"pixels_per_sec\": %.0f, \"peak_rss_kb\": %ld}\n",
+           kind.c_str(), size, layoutField.c_str(), triangles, pixels, loadMs, renderMs,
+           triangles / (renderMs / 1000), pixels / (renderMs / 1000), usage.ru_maxrss);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = "bench_scenes";
+    int horRes = 640, verRes = 480;
+    bool quick = false;
+    bool instanced = false;
+    vector<string> layouts(1, "");
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--dir" && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+        else if (arg == "--res" && i + 2 < argc)
+        {
+            horRes = atoi(argv[++i]);
+            verRes = atoi(argv[++i]);
+        }
+        else if (arg == "--quick")
+        {
+            quick = true;
+        }
+        else if (arg == "--instanced")
+        {
+            instanced = true;
+        }
+        else if (arg == "--layout" && i + 1 < argc && (strcmp(argv[i + 1], "linear") == 0 || strcmp(argv[i + 1], "tiled") == 0))
+        {
+            layouts.assign(1, argv[++i]);
+        }
+        else if (arg == "--layout" && i + 1 < argc && strcmp(argv[i + 1], "both") == 0)
+        {
+            i++;
+            layouts.clear();
+            layouts.push_back("linear");
+            layouts.push_back("tiled");
+        }
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--dir <scene directory>] [--res <width> <height>] [--quick] [--instanced] [--layout linear|tiled|both]" << endl;
+            return 1;
+        }
+    }
+
+    mkdir(dir.c_str(), 0755);
+
+    const char *kinds[] = {"grid", "sphere", "mixed", "cameras"};
+    int sizes[4][3] = {{4, 16, 64}, {16, 64, 256}, {4, 16, 64}, {1, 8, 32}};
+    int sizeCount = quick ? 2 : 3;
+
+    for (int k = 0; k < 4; k++)
+    {
+        for (int s = 0; s < sizeCount; s++)
+        {
+            SceneDescription description;
+            int size = sizes[k][s];
+
+            ostringstream name;
+            name << kinds[k] << "_" << size;
+            description.name = name.str();
+            description.instanced = instanced;
+
+            if (k == 0)
+                makeGrid(description, size, horRes, verRes);
+            else if (k == 1)
+                makeSphere(description, size, horRes, verRes);
+            else if (k == 2)
+                makeMixed(description, size, horRes, verRes);
+            else
+                makeCameras(description, size, horRes, verRes);
+
+            ostringstream path;
+            path << dir << "/" << description.name << ".xml";
+            description.write(path.str());
+
+            for (size_t l = 0; l < layouts.size(); l++)
+            {
+                pid_t pid = fork();
+                if (pid == 0)
+                {
+                    runCase(kinds[k], size, path.str(), layouts[l]);
+                    _exit(0);
+                }
+
+                int status;
+                waitpid(pid, &status, 0);
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                {
+                    cerr << path.str() << " failed" << endl;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}